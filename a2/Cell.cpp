@@ -13,18 +13,73 @@
  * dummy implementation, which you'll throw away anyhow.
  */
 
-#include "Cell.hpp"
+#include "cons.hpp"
+#include "arena.hpp"
+#include <algorithm>
+#include <cstring>
+#include <new>
 // Reminder: cons.hpp expects nil to be defined somewhere.  For this
 // implementation, this is the logical place to define it.
 Cell* const nil = new NilCell();
 
 using namespace std;
 
+#ifndef NAN_BOXING
+
+Cell* small_doubles[SMALL_DOUBLE_MAX - SMALL_DOUBLE_MIN + 1];
+
+namespace {
+
+/**
+ * \brief Fills small_doubles with permanent cells, which the collector
+ * never frees, marked canonical so hash-consed pairs may hold them.
+ */
+struct SmallDoubles {
+  SmallDoubles()
+  {
+    for (int i = SMALL_DOUBLE_MIN; i <= SMALL_DOUBLE_MAX; ++i) {
+      Cell* c = ::new (permanent_allocate(sizeof(DoubleCell))) DoubleCell(i);
+      c->set_canonical();
+      small_doubles[i - SMALL_DOUBLE_MIN] = c;
+    }
+  }
+} small_doubles_init;
+
+}
+
+#endif
+
 /**
  * \brief Distructor
  */
 Cell::~Cell() {};
 
+/**
+ * \brief Allocate a cell from the current arena, if there is one, or
+ * else from the pool of its size.
+ * \param size The size of the cell.
+ */
+void* Cell::operator new(size_t size)
+{
+  if (NULL != current_arena) {
+    return current_arena->allocate(size);
+  }
+  return pool_allocate(size);
+}
+
+/**
+ * \brief Return a pool cell to its pool.  Arena cells are released
+ * with their arena instead, and permanent cells are never released.
+ * \param p The cell memory.
+ */
+void Cell::operator delete(void* p)
+{
+  SlabKind kind = slab_of(p)->kind;
+  if (SLAB_POOL == kind || SLAB_LARGE == kind) {
+    pool_free(p);
+  }
+}
+
 /**
  * \brief Make a copy of this cell.
  * \return A new cell copy of this cell.
@@ -83,7 +138,7 @@ bool Cell::is_nil() const
  * \brief Accessor (error if this is not an int cell).
  * \return The value in this int cell.
  */
-int Cell::get_int() const
+int64_t Cell::get_int() const
 {
   throw runtime_error("ERROR: Get int for non-int cell.\n");
 }
@@ -194,7 +249,7 @@ int Cell::not_c() const
 /**
  * \brief Build IntCell
  */
-IntCell::IntCell(int n)
+IntCell::IntCell(int64_t n) : Cell(CELL_INT)
 {
     i = n;
 }
@@ -221,7 +276,7 @@ bool IntCell::is_int() const
  * \brief Accessor (error if this is not an int cell).
  * \return The value in this int cell.
  */
-int IntCell::get_int() const
+int64_t IntCell::get_int() const
 {
   return i;
 }
@@ -261,7 +316,7 @@ void IntCell::multi_c(bool& is_int, double& n) const
  */
 Cell* IntCell::ceiling_c() const
 {
-  return new IntCell(i);
+  return make_int(i);
 }
 
 /**
@@ -270,7 +325,7 @@ Cell* IntCell::ceiling_c() const
  */
 Cell* IntCell::floor_c() const
 {
-  return new IntCell(i);
+  return make_int(i);
 }
 
 /**
@@ -300,7 +355,7 @@ int IntCell::not_c() const
 /**
  * \brief Build DoubleCell
  */
-DoubleCell::DoubleCell(double n)
+DoubleCell::DoubleCell(double n) : Cell(CELL_DOUBLE)
 {
     d = n;
 }
@@ -369,7 +424,7 @@ void DoubleCell::multi_c(bool& is_int, double& n) const
  */
 Cell* DoubleCell::ceiling_c() const
 {
-  return new IntCell((int)ceil(d));
+  return make_num(true, ceil(d));
 }
 
 /**
@@ -378,7 +433,7 @@ Cell* DoubleCell::ceiling_c() const
  */
 Cell* DoubleCell::floor_c() const
 {
-  return new IntCell((int)floor(d));
+  return make_num(true, floor(d));
 }
 
 /**
@@ -403,15 +458,120 @@ int DoubleCell::not_c() const
 
 
 
+/// BigIntCell
+
+/**
+ * \brief Build BigIntCell
+ */
+BigIntCell::BigIntCell(bool negative, const uint64_t* limbs, size_t count)
+  : Cell(CELL_BIGINT), n(static_cast<uint32_t>(count)), negative(negative)
+{
+  if (is_large()) {
+    big = new uint64_t[n];
+    pool_count_external(n * sizeof(uint64_t));
+  }
+  memcpy(is_large() ? big : small, limbs, n * sizeof(uint64_t));
+}
+
+/**
+ * \brief Distructor
+ */
+BigIntCell::~BigIntCell()
+{
+  if (is_large()) {
+    delete[] big;
+  }
+}
+
+/**
+ * \brief Make a copy of this cell.
+ * \return A new cell copy of this cell.
+ */
+BigIntCell* BigIntCell::clone() const
+{
+  return static_cast<BigIntCell*>(make_bigint(negative, limbs(), n));
+}
+
+/**
+ * \brief Print the subtree rooted at this cell, in s-expression notation.
+ * \param os The output stream to print to.
+ */
+void BigIntCell::print(std::ostream& os) const
+{
+  os << big_to_string(BigInt(negative, limbs(), n));
+}
+
+/**
+ * \brief The plus cell function.
+ * \param is_int Record the output type.
+ * \param n The number to be added.
+ */
+void BigIntCell::plus_c(bool& is_int, double& n) const
+{
+  n += big_to_double(BigInt(negative, limbs(), this->n));
+}
+
+/**
+ * \brief The multiply cell function.
+ * \param is_int Record the output type.
+ * \param n The number to be added.
+ */
+void BigIntCell::multi_c(bool& is_int, double& n) const
+{
+  n *= big_to_double(BigInt(negative, limbs(), this->n));
+}
+
+/**
+ * \brief The ceiling cell function.
+ * \return The ceilinged number.
+ */
+Cell* BigIntCell::ceiling_c() const
+{
+  return clone();
+}
+
+/**
+ * \brief The floor cell function.
+ * \return The floored number.
+ */
+Cell* BigIntCell::floor_c() const
+{
+  return clone();
+}
+
+/**
+ * \brief The less cell function.
+ * \param b Record whether the passed in value is smaller.
+ * \param n Pass into a value.
+ */
+void BigIntCell::less_c(bool& b, double& n) const
+{
+  double m = big_to_double(BigInt(negative, limbs(), this->n));
+  b = b || n < m;
+  n = m;
+}
+
+/**
+ * \brief The not cell function.
+ * \return 0, as a bignum is never zero.
+ */
+int BigIntCell::not_c() const
+{
+  return 0;
+}
+
+
+
 /// SymbolCell
 
 /**
  * \brief Build SymbolCell
  */
-SymbolCell::SymbolCell(const char* const s)
+SymbolCell::SymbolCell(std::string_view s) : Cell(CELL_SYMBOL), primitive(-1)
 {
-  c = new char[strlen(s) + 1];
-  strcpy(c, s);
+  c = new char[s.size() + 1];
+  memcpy(c, s.data(), s.size());
+  c[s.size()] = '\0';
 }
 
 /**
@@ -423,12 +583,12 @@ SymbolCell::~SymbolCell()
 }
 
 /**
- * \brief Make a copy of this cell.
- * \return A new cell copy of this cell.
+ * \brief Symbols are interned, so the copy of a symbol is itself.
+ * \return This cell.
  */
 SymbolCell* SymbolCell::clone() const
 {
-  return new SymbolCell(c);
+  return const_cast<SymbolCell*>(this);
 }
 
 /**
@@ -465,19 +625,56 @@ void SymbolCell::print(std::ostream& os) const
 /**
  * \brief Build SymbolCell
  */
-ConsCell::ConsCell(Cell* const my_car, Cell* const my_cdr)
+ConsCell::ConsCell(Cell* const my_car, Cell* const my_cdr) : Cell(CELL_CONS)
 {
   car = my_car;
   cdr = my_cdr;
+  // a cell made while marking is black, so its children must not stay
+  // white; arena cells are traced in the final pass instead
+  if (gc_marking && NULL == current_arena) {
+    if (!immediatep(my_car)) {
+      gc_shade(my_car);
+    }
+    if (!immediatep(my_cdr)) {
+      gc_shade(my_cdr);
+    }
+  }
 }
 
 /**
  * \brief Make a copy of this cell.
+ *
+ * The copy is built with an explicit stack of cells whose children are
+ * still to be copied, so its depth is not limited by the C++ stack.
+ * The empty list is shared rather than copied.
+ *
  * \return A new cell copy of this cell.
  */
 ConsCell* ConsCell::clone() const
 {
-  return new ConsCell(this->car->clone(), this->cdr->clone());
+  ConsCell* root = new ConsCell(nil, nil);
+  vector<pair<const ConsCell*, ConsCell*> > pending;
+  pending.push_back(make_pair(this, root));
+  while (!pending.empty()) {
+    const ConsCell* from = pending.back().first;
+    ConsCell* to = pending.back().second;
+    pending.pop_back();
+    Cell* const* children[] = { &from->car, &from->cdr };
+    Cell** copies[] = { &to->car, &to->cdr };
+    for (int i = 0; i < 2; ++i) {
+      Cell* child = *children[i];
+      if (immediatep(child) || child == nil) {
+        *copies[i] = child;
+      } else if (child->type() == CELL_CONS) {
+        ConsCell* copy = new ConsCell(nil, nil);
+        *copies[i] = copy;
+        pending.push_back(make_pair(static_cast<ConsCell*>(child), copy));
+      } else {
+        *copies[i] = child->clone();
+      }
+    }
+  }
+  return root;
 }
 
 /**
@@ -509,20 +706,104 @@ Cell* ConsCell::get_cdr() const
 
 /**
  * \brief Print the subtree rooted at this cell, in s-expression notation.
+ *
+ * Lists are printed with an explicit stack holding the rest of every
+ * list still open, so nesting depth is not limited by the C++ stack.
+ * Elements of a list with more than one element are each followed by
+ * a space.
+ *
  * \param os The output stream to print to.
  */
 void ConsCell::print(std::ostream& os) const
 {
+  struct OpenList
+  {
+    const Cell* rest;
+    bool spaced;
+  };
+  vector<OpenList> open;
   os << "(";
-  const Cell* cur = this;
-  if (this->get_cdr() == nil) {
-    cur->get_car()->print();
-  } else {
-    while (cur != nil) {
-      cur->get_car()->print();
+  OpenList top = { this, cdr != nil };
+  open.push_back(top);
+  while (!open.empty()) {
+    const Cell* rest = open.back().rest;
+    bool spaced = open.back().spaced;
+    if (rest == nil) {
+      os << ")";
+      open.pop_back();
+      if (!open.empty() && open.back().spaced) {
+        os << " ";
+      }
+      continue;
+    }
+    const Cell* elem = rest->get_car();
+    open.back().rest = rest->get_cdr();
+    if (!immediatep(elem) && elem != nil && elem->type() == CELL_CONS) {
+      os << "(";
+      OpenList inner = { elem, elem->get_cdr() != nil };
+      open.push_back(inner);
+    } else {
+      print_cell(os, elem);
+      if (spaced) {
+        os << " ";
+      }
+    }
+  }
+}
+
+
+
+/// VectorCell
+
+/**
+ * \brief Build VectorCell
+ */
+VectorCell::VectorCell(size_t count, Cell* fill)
+  : Cell(CELL_VECTOR), n(count), items(new Cell*[count])
+{
+  pool_count_external(n * sizeof(Cell*));
+  fill_n(items, n, fill);
+}
+
+/**
+ * \brief Build VectorCell
+ */
+VectorCell::VectorCell(Cell* const* elems, size_t count)
+  : Cell(CELL_VECTOR), n(count), items(new Cell*[count])
+{
+  pool_count_external(n * sizeof(Cell*));
+  copy(elems, elems + n, items);
+}
+
+/**
+ * \brief Distructor
+ */
+VectorCell::~VectorCell()
+{
+  delete[] items;
+}
+
+/**
+ * \brief Make a copy of this cell, sharing the elements.
+ * \return A new cell copy of this cell.
+ */
+VectorCell* VectorCell::clone() const
+{
+  return static_cast<VectorCell*>(make_vector(items, n));
+}
+
+/**
+ * \brief Print the elements in s-expression notation, as #(a b c).
+ * \param os The output stream to print to.
+ */
+void VectorCell::print(std::ostream& os) const
+{
+  os << "#(";
+  for (size_t i = 0; i < n; ++i) {
+    if (0 != i) {
       os << " ";
-      cur = cur->get_cdr();
     }
+    print_cell(os, items[i]);
   }
   os << ")";
 }
@@ -535,7 +816,7 @@ void ConsCell::print(std::ostream& os) const
 /**
  * \brief Build ConsCell
  */
-NilCell::NilCell() {}
+NilCell::NilCell() : Cell(CELL_NIL) {}
 
 /**
  * \brief Make a copy of this cell.
@@ -23,23 +23,91 @@
 #define CELL_HPP
 
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <stack>
+#include <vector>
 #include <math.h>
 
 
+/**
+ * \brief The concrete type of a cell, stored in every cell so type
+ * checks are a byte compare instead of a virtual call.
+ */
+enum CellType : unsigned char {
+  CELL_INT,
+  CELL_DOUBLE,
+  CELL_SYMBOL,
+  CELL_CONS,
+  CELL_NIL,
+  CELL_BIGINT,
+  CELL_VECTOR
+};
+
+
 /**
  * \class Cell.
  * \brief Cell class which contains parsed data for multiple data types.
  */
 class Cell {
 
+private:
+
+  /**
+   * \brief The concrete type of this cell.
+   */
+  const CellType tag;
+
+  /**
+   * \brief Whether this cell is in the hash-consing table.
+   */
+  bool canonical;
+
+protected:
+
+  /**
+   * \brief Build a cell of the given type.
+   */
+  Cell(CellType t) : tag(t), canonical(false) {}
+
 public:
 
+  /**
+   * \brief The concrete type of this cell.
+   * \return The type tag.
+   */
+  CellType type() const { return tag; }
+
+  /**
+   * \brief Check if this is the canonical cell of its content.
+   * \return True iff this cell was made by hash-consing.
+   */
+  bool is_canonical() const { return canonical; }
+
+  /**
+   * \brief Record that this is the canonical cell of its content.
+   */
+  void set_canonical() { canonical = true; }
+
+  /**
+   * \brief Allocate a cell from the current arena, if there is one, or
+   * else from the pool of its size.
+   * \param size The size of the cell.
+   */
+  static void* operator new(size_t size);
+
+  /**
+   * \brief Return a pool cell to its pool.  Arena cells are released
+   * with their arena instead, and permanent cells are never released.
+   * \param p The cell memory.
+   */
+  static void operator delete(void* p);
+
   /**
    * \brief Distructor
    */
@@ -85,7 +153,7 @@ public:
    * \brief Accessor (error if this is not an int cell).
    * \return The value in this int cell.
    */
-  virtual int get_int() const;
+  virtual int64_t get_int() const;
 
   /**
    * \brief Accessor (error if this is not a double cell).
@@ -169,14 +237,20 @@ private:
   /**
    * \brief The content.
    */
-  int i;
+  int64_t i;
 
 public:
 
   /**
    * \brief Build IntCell
    */
-  IntCell(int n);
+  IntCell(int64_t n);
+
+  /**
+   * \brief Non-virtual accessor, for callers that checked the tag.
+   * \return The value in this int cell.
+   */
+  int64_t value() const { return i; }
 
   /**
    * \brief Make a copy of this cell.
@@ -194,7 +268,7 @@ public:
    * \brief Accessor (error if this is not an int cell).
    * \return The value in this int cell.
    */
-  int get_int() const override;
+  int64_t get_int() const override;
 
   /**
    * \brief Print the subtree rooted at this cell, in s-expression notation.
@@ -270,6 +344,12 @@ public:
    */
   DoubleCell(double n);
 
+  /**
+   * \brief Non-virtual accessor, for callers that checked the tag.
+   * \return The value in this double cell.
+   */
+  double value() const { return d; }
+
   /**
    * \brief Make a copy of this cell.
    * \return A new cell copy of this cell.
@@ -343,6 +423,129 @@ public:
 
 
 
+/**
+ * \class BigInt cell.
+ * \brief A cell contains an int too large for int64_t, as a sign and a
+ * little-endian magnitude of 64-bit limbs.  Magnitudes of up to two
+ * limbs are stored in the cell itself, so moderately large values
+ * allocate nothing more; longer ones get an array of their own.
+ */
+class BigIntCell: public Cell
+{
+private:
+
+  /**
+   * \brief The number of limbs, never zero.
+   */
+  uint32_t n;
+
+  /**
+   * \brief The sign.
+   */
+  bool negative;
+
+  /**
+   * \brief The magnitude: in place up to two limbs, else on the heap.
+   */
+  union {
+    uint64_t small[2];
+    uint64_t* big;
+  };
+
+public:
+
+  /**
+   * \brief Build BigIntCell
+   * \param negative The sign.
+   * \param limbs The magnitude, little-endian, without leading zeros.
+   * \param count The number of limbs.
+   */
+  BigIntCell(bool negative, const uint64_t* limbs, size_t count);
+
+  /**
+   * \brief Distructor
+   */
+  ~BigIntCell();
+
+  /**
+   * \brief Check if the magnitude is too long to be stored in place.
+   * \return True iff the limbs are on the heap.
+   */
+  bool is_large() const { return n > 2; }
+
+  /**
+   * \brief Accessor.
+   * \return True iff the value is negative.
+   */
+  bool is_negative() const { return negative; }
+
+  /**
+   * \brief Accessor.
+   * \return The number of limbs.
+   */
+  size_t size() const { return n; }
+
+  /**
+   * \brief Accessor.
+   * \return The magnitude, little-endian.
+   */
+  const uint64_t* limbs() const { return is_large() ? big : small; }
+
+  /**
+   * \brief Make a copy of this cell.
+   * \return A new cell copy of this cell.
+   */
+  BigIntCell* clone() const override;
+
+  /**
+   * \brief Print the subtree rooted at this cell, in s-expression notation.
+   * \param os The output stream to print to.
+   */
+  void print(std::ostream& os = std::cout) const override;
+
+  /**
+   * \brief The plus cell function.
+   * \param is_int Record the output type.
+   * \param n The number be added.
+   */
+  void plus_c(bool& is_int, double& n) const override;
+
+  /**
+   * \brief The multiply cell function.
+   * \param is_int Record the output type.
+   * \param n The number be added.
+   */
+  void multi_c(bool& is_int, double& n) const override;
+
+  /**
+   * \brief The ceiling cell function.
+   * \return The ceilinged number.
+   */
+  Cell* ceiling_c() const override;
+
+  /**
+   * \brief The floor cell function.
+   * \return The floored number.
+   */
+  Cell* floor_c() const override;
+
+  /**
+   * \brief The less cell function.
+   * \param b Record whether the passed in value is smaller.
+   * \param n Pass in a value.
+   */
+  void less_c(bool& b, double& n) const override;
+
+  /**
+   * \brief The not cell function.
+   * \return 0, as a bignum is never zero.
+   */
+  int not_c() const override;
+
+};
+
+
+
 class SymbolCell: public Cell
 {
 private:
@@ -352,12 +555,35 @@ private:
    */
   char* c;
 
+  /**
+   * \brief Index of the primitive registered under this symbol, or -1.
+   */
+  int primitive;
+
 public:
 
   /**
    * \brief Build SymbolCell
    */
-  SymbolCell(const char* const s);
+  SymbolCell(std::string_view s);
+
+  /**
+   * \brief The primitive table slot of this symbol.
+   * \return The index, or -1 if no primitive is registered.
+   */
+  int primitive_slot() const { return primitive; }
+
+  /**
+   * \brief Record the primitive table slot of this symbol.
+   * \param slot The index.
+   */
+  void set_primitive_slot(int slot) { primitive = slot; }
+
+  /**
+   * \brief Non-virtual accessor, without copying the name.
+   * \return The name in this symbol cell.
+   */
+  std::string_view name() const { return c; }
 
   /**
    * \brief Distructor
@@ -365,8 +591,8 @@ public:
   ~SymbolCell();
 
   /**
-   * \brief Make a copy of this cell.
-   * \return A new cell copy of this cell.
+   * \brief Symbols are interned, so the copy of a symbol is itself.
+   * \return This cell.
    */
   SymbolCell* clone() const override;
 
@@ -416,6 +642,30 @@ public:
    */
   ConsCell(Cell* const my_car, Cell* const my_cdr);
 
+  /**
+   * \brief Non-virtual accessor, for callers that checked the tag.
+   * \return First child cell.
+   */
+  Cell* head() const { return car; }
+
+  /**
+   * \brief Non-virtual accessor, for callers that checked the tag.
+   * \return Rest child cell.
+   */
+  Cell* tail() const { return cdr; }
+
+  /**
+   * \brief Replace the first child, without a write barrier.
+   * \param c The new child.
+   */
+  void set_head(Cell* c) { car = c; }
+
+  /**
+   * \brief Replace the rest child, without a write barrier.
+   * \param c The new child.
+   */
+  void set_tail(Cell* c) { cdr = c; }
+
   /**
    * \brief Make a copy of this cell.
    * \return A new cell copy of this cell.
@@ -454,6 +704,81 @@ public:
 };
 
 
+
+/**
+ * \class Vector cell.
+ * \brief A cell contains a fixed number of values in one contiguous
+ * array, for constant time indexing.
+ */
+class VectorCell: public Cell
+{
+private:
+
+  /**
+   * \brief The number of elements.
+   */
+  size_t n;
+
+  /**
+   * \brief The elements, on the heap.
+   */
+  Cell** items;
+
+public:
+
+  /**
+   * \brief Build VectorCell
+   * \param count The number of elements.
+   * \param fill The initial value of every element.
+   */
+  VectorCell(size_t count, Cell* fill);
+
+  /**
+   * \brief Build VectorCell
+   * \param elems The initial elements.
+   * \param count The number of elements.
+   */
+  VectorCell(Cell* const* elems, size_t count);
+
+  /**
+   * \brief Distructor
+   */
+  ~VectorCell();
+
+  /**
+   * \brief Accessor.
+   * \return The number of elements.
+   */
+  size_t size() const { return n; }
+
+  /**
+   * \brief Non-virtual accessor, for callers that checked the index.
+   * \param i The index.
+   * \return The element.
+   */
+  Cell* item(size_t i) const { return items[i]; }
+
+  /**
+   * \brief Replace an element, without a write barrier.
+   * \param i The index.
+   * \param c The new element.
+   */
+  void set_item(size_t i, Cell* c) { items[i] = c; }
+
+  /**
+   * \brief Make a copy of this cell, sharing the elements.
+   * \return A new cell copy of this cell.
+   */
+  VectorCell* clone() const override;
+
+  /**
+   * \brief Print the elements in s-expression notation, as #(a b c).
+   * \param os The output stream to print to.
+   */
+  void print(std::ostream& os = std::cout) const override;
+};
+
+
 /**
  * \brief Nil cell, to handle nil.
  */
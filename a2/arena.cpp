@@ -0,0 +1,110 @@
+/**
+ * \file arena.cpp
+ *
+ * Implementation of the expression arena.
+ */
+
+#include "arena.hpp"
+#include "gc.hpp"
+
+using namespace std;
+
+thread_local Arena* current_arena = NULL;
+
+/**
+ * \brief Build an empty arena.
+ */
+Arena::Arena() : current(0), cur(NULL), limit(NULL) {}
+
+/**
+ * \brief Free every chunk.
+ */
+Arena::~Arena()
+{
+  for (SlabHeader* chunk : chunks) {
+    delete_slab(chunk);
+  }
+}
+
+/**
+ * \brief Move on to the next chunk, taking a new one if needed.
+ */
+void Arena::next_chunk()
+{
+  if (NULL != cur) {
+    ++current;
+  }
+  if (current == chunks.size()) {
+    chunks.push_back(new_slab(SLAB_ARENA));
+    chunks.back()->size = current;
+  }
+  cur = slab_begin(chunks[current]);
+  limit = cur + ARENA_CHUNK_SIZE;
+}
+
+/**
+ * \brief The current position.
+ * \return A mark that reset() can return to.
+ */
+Arena::Mark Arena::mark() const
+{
+  Mark m = { current, cur };
+  return m;
+}
+
+/**
+ * \brief Release everything allocated since m, without running any
+ * destructors.
+ * \param m A mark taken earlier from this arena.
+ */
+void Arena::reset(const Mark& m)
+{
+  current = m.chunk;
+  cur = m.cur;
+  limit = NULL == cur ? NULL : slab_begin(chunks[current]) + ARENA_CHUNK_SIZE;
+}
+
+/**
+ * \brief Accessor.
+ * \return The number of bytes held in chunks.
+ */
+size_t Arena::capacity() const
+{
+  return chunks.size() * ARENA_CHUNK_SIZE;
+}
+
+/**
+ * \brief Make arena current, remembering its position.
+ */
+ArenaScope::ArenaScope(Arena& arena)
+  : arena(arena), previous(current_arena), start(arena.mark())
+{
+  current_arena = &arena;
+}
+
+/**
+ * \brief Evacuate the survivors, reset the arena and restore the
+ * previous one.
+ */
+ArenaScope::~ArenaScope()
+{
+  gc_evacuate(arena, start);
+  arena.reset(start);
+  current_arena = previous;
+}
+
+/**
+ * \brief Suspend the current arena.
+ */
+HeapScope::HeapScope() : previous(current_arena)
+{
+  current_arena = NULL;
+}
+
+/**
+ * \brief Restore the current arena.
+ */
+HeapScope::~HeapScope()
+{
+  current_arena = previous;
+}
@@ -0,0 +1,176 @@
+/**
+ * \file arena.hpp
+ *
+ * Encapsulates the interface for the expression arena, a bump
+ * allocator that cells are taken from while a top-level expression is
+ * parsed and evaluated, and that is released in one step afterwards.
+ *
+ * The arena is the young generation of the heap: when a scope ends,
+ * the cells allocated within it that are still reachable are first
+ * evacuated into the pools (see gc.hpp).
+ */
+
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include "Cell.hpp"
+#include "pool.hpp"
+#include <cstddef>
+#include <vector>
+
+/**
+ * \brief Usable bytes in each chunk of an arena.
+ */
+const size_t ARENA_CHUNK_SIZE = SLAB_SIZE - sizeof(SlabHeader);
+
+/**
+ * \class Arena.
+ * \brief Bump allocator over a list of chunks, which are kept for reuse
+ * when the arena is reset.  Chunks are slabs of kind SLAB_ARENA, so
+ * arena cells can be told from pool cells by their address.
+ */
+class Arena
+{
+public:
+
+  /**
+   * \brief A position in the arena, to reset to.
+   */
+  struct Mark {
+    size_t chunk;
+    char* cur;
+  };
+
+  /**
+   * \brief Build an empty arena.
+   */
+  Arena();
+
+  /**
+   * \brief Free every chunk.
+   */
+  ~Arena();
+
+  /**
+   * \brief Allocate size bytes, 8-byte aligned.
+   * \param size The number of bytes, at most ARENA_CHUNK_SIZE.
+   * \return The memory.
+   */
+  void* allocate(size_t size)
+  {
+    size = (size + 7) & ~static_cast<size_t>(7);
+    if (static_cast<size_t>(limit - cur) < size) {
+      next_chunk();
+    }
+    void* p = cur;
+    cur += size;
+    return p;
+  }
+
+  /**
+   * \brief The current position.
+   * \return A mark that reset() can return to.
+   */
+  Mark mark() const;
+
+  /**
+   * \brief Release everything allocated since m, without running any
+   * destructors.
+   * \param m A mark taken earlier from this arena.
+   */
+  void reset(const Mark& m);
+
+  /**
+   * \brief Check if p was allocated from this arena after m.
+   * \param p A cell.
+   * \param m A mark taken earlier from this arena.
+   * \return True iff p lies between m and the current position.
+   */
+  bool allocated_since(const void* p, const Mark& m) const
+  {
+    SlabHeader* slab = slab_of(p);
+    if (SLAB_ARENA != slab->kind || slab->size >= chunks.size()
+        || chunks[slab->size] != slab || slab->size < m.chunk
+        || slab->size > current) {
+      return false;
+    }
+    const char* q = static_cast<const char*>(p);
+    return (slab->size > m.chunk || q >= m.cur) && (slab->size < current || q < cur);
+  }
+
+  /**
+   * \brief Accessor.
+   * \return The number of bytes held in chunks.
+   */
+  size_t capacity() const;
+
+private:
+
+  /**
+   * \brief Move on to the next chunk, taking a new one if needed.
+   */
+  void next_chunk();
+
+  std::vector<SlabHeader*> chunks;
+  size_t current;
+  char* cur;
+  char* limit;
+};
+
+/**
+ * \brief The arena new cells are taken from on this thread, or NULL to
+ * take them from the heap.
+ */
+extern thread_local Arena* current_arena;
+
+/**
+ * \class ArenaScope.
+ * \brief Makes an arena current for the lifetime of the scope.  When
+ * the scope ends, the cells allocated within it that are reachable
+ * from the roots are evacuated to the heap, and the rest are released.
+ */
+class ArenaScope
+{
+public:
+
+  /**
+   * \brief Make arena current, remembering its position.
+   */
+  ArenaScope(Arena& arena);
+
+  /**
+   * \brief Evacuate the survivors, reset the arena and restore the
+   * previous one.
+   */
+  ~ArenaScope();
+
+private:
+  Arena& arena;
+  Arena* previous;
+  Arena::Mark start;
+};
+
+/**
+ * \class HeapScope.
+ * \brief Sends new cells to the heap for the lifetime of the scope,
+ * even inside an ArenaScope.
+ */
+class HeapScope
+{
+public:
+
+  /**
+   * \brief Suspend the current arena.
+   */
+  HeapScope();
+
+  /**
+   * \brief Restore the current arena.
+   */
+  ~HeapScope();
+
+private:
+  Arena* previous;
+};
+
+#endif // ARENA_HPP
@@ -0,0 +1,467 @@
+/**
+ * \file bench.cpp
+ *
+ * Micro benchmarks for the interpreter.  Each benchmark builds a
+ * synthetic input of growing size and reports the time per element,
+ * which should stay flat when the measured operation scales linearly.
+ */
+
+#include "parse.hpp"
+#include "eval.hpp"
+#include "scan.hpp"
+#include "pool.hpp"
+#include "arena.hpp"
+#include "gc.hpp"
+#include <chrono>
+#include <thread>
+#include <sys/resource.h>
+#include <cstring>
+
+using namespace std;
+
+/**
+ * \brief Build a flat list of n integers, e.g. "(0 1 2 ...)".
+ * \param n The number of elements.
+ */
+string make_wide(int n)
+{
+  ostringstream os;
+  os << "(";
+  for (int i = 0; i < n; ++i) {
+    os << i << " ";
+  }
+  os << ")";
+  return os.str();
+}
+
+/**
+ * \brief Build a list nested n levels deep, e.g. "(((1)))".
+ * \param n The nesting depth.
+ */
+string make_deep(int n)
+{
+  return string(n, '(') + "1" + string(n, ')');
+}
+
+/**
+ * \brief Time parsing of an input and print one result row.
+ * \param name The label of the input shape.
+ * \param n The number of elements in the input.
+ * \param sexpr The input text.
+ */
+void time_parse(const char* name, int n, const string& sexpr)
+{
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  parse(sexpr);
+  chrono::steady_clock::time_point stop = chrono::steady_clock::now();
+  double ns = chrono::duration<double, nano>(stop - start).count();
+  cout << name << "\t" << n << "\t" << ns / 1e6 << " ms\t"
+       << ns / n << " ns/element" << endl;
+}
+
+/**
+ * \brief Parse wide and deep inputs of doubling size.
+ */
+void bench_parse()
+{
+  for (int n = 1000; n <= 256000; n *= 2) {
+    time_parse("wide", n, make_wide(n));
+  }
+  for (int n = 1000; n <= 16000; n *= 2) {
+    time_parse("deep", n, make_deep(n));
+  }
+}
+
+/**
+ * \brief Count the parentheses and quotes in text one byte at a time.
+ * \param text The input text.
+ */
+size_t count_scalar(const string& text)
+{
+  size_t n = 0;
+  for (char ch : text) {
+    if ('(' == ch || ')' == ch || '\"' == ch) {
+      ++n;
+    }
+  }
+  return n;
+}
+
+/**
+ * \brief Count the parentheses and quotes in text by jumping between
+ * them with the structural scanner.
+ * \param text The input text.
+ */
+size_t count_structural(const string& text)
+{
+  size_t n = 0;
+  const char* end = text.data() + text.size();
+  ScanIndex index(end);
+  const char* cur = index.find(text.data(), SCAN_OPEN | SCAN_CLOSE | SCAN_QUOTE);
+  while (cur < end) {
+    ++n;
+    cur = index.find(cur + 1, SCAN_OPEN | SCAN_CLOSE | SCAN_QUOTE);
+  }
+  return n;
+}
+
+/**
+ * \brief Compare byte-at-a-time and structural scanning for structural
+ * characters over symbol- and string-heavy text.
+ */
+void bench_scan()
+{
+  ostringstream os;
+  for (int i = 0; i < 200000; ++i) {
+    os << "(quote (configuration-entry-" << i
+       << " \"a long string literal inside the entry\" value))\n";
+  }
+  string text = os.str();
+  size_t (*scanners[])(const string&) = { count_scalar, count_structural };
+  const char* names[] = { "bytewise", "structural" };
+  for (int k = 0; k < 2; ++k) {
+    // the best of several passes, to keep out noise from other work
+    size_t n = 0;
+    double ms = 0;
+    for (int rep = 0; rep < 10; ++rep) {
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      n = scanners[k](text);
+      chrono::steady_clock::time_point stop = chrono::steady_clock::now();
+      double t = chrono::duration<double, milli>(stop - start).count();
+      ms = (0 == rep || t < ms) ? t : ms;
+    }
+    cout << names[k] << "\t" << text.size() << " bytes\t" << n
+         << " found\t" << ms << " ms" << endl;
+  }
+}
+
+/**
+ * \brief Count the number cells in a tree, checking types through the
+ * virtual predicates, as cons.hpp did before cells carried a tag.
+ * \param c The root of the tree.
+ */
+size_t count_virtual(Cell* const c)
+{
+  if (immediatep(c)) {
+    return 1;
+  }
+  if (!c->is_nil() && c->is_cons()) {
+    return count_virtual(c->get_car()) + count_virtual(c->get_cdr());
+  }
+  return (!c->is_nil() && (c->is_int() || c->is_double())) ? 1 : 0;
+}
+
+/**
+ * \brief Count the number cells in a tree through the cons.hpp
+ * predicates, which switch on the type tag.
+ * \param c The root of the tree.
+ */
+size_t count_tagged(Cell* const c)
+{
+  if (listp(c) && !nullp(c)) {
+    return count_tagged(car(c)) + count_tagged(cdr(c));
+  }
+  return (intp(c) || doublep(c)) ? 1 : 0;
+}
+
+/**
+ * \brief Compare type dispatch through virtual calls and through the
+ * tag byte, on a scaled-up arithmetic workload like testinput.txt, and
+ * time evaluating the same workload and one with small results.
+ */
+void bench_dispatch()
+{
+  vector<Cell*> trees;
+  for (int i = 0; i < 100000; ++i) {
+    ostringstream os;
+    os << "(+ " << i << " (* 2.5 (- " << i << " 3) 4) (ceiling 1.5) (if 0 1 "
+       << i << ".25))";
+    trees.push_back(parse(os.str()));
+  }
+  size_t (*counters[])(Cell* const) = { count_virtual, count_tagged };
+  const char* names[] = { "virtual", "tagged" };
+  for (int k = 0; k < 2; ++k) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    size_t n = 0;
+    for (int rep = 0; rep < 10; ++rep) {
+      for (Cell* tree : trees) {
+        n += counters[k](tree);
+      }
+    }
+    chrono::steady_clock::time_point stop = chrono::steady_clock::now();
+    double ns = chrono::duration<double, nano>(stop - start).count();
+    cout << names[k] << "\t" << n << " numbers\t" << ns / 1e6 << " ms\t"
+         << ns / n << " ns/number" << endl;
+  }
+  // the second workload only has small integral results, which are
+  // shared cells
+  vector<Cell*> small;
+  for (int i = 0; i < 100000; ++i) {
+    ostringstream os;
+    os << "(+ (* 2.0 " << i % 100 << ".0) (- 3.0 1.0) (* 0.5 4) " << i % 7 << ".0)";
+    small.push_back(parse(os.str()));
+  }
+  const vector<Cell*>* workloads[] = { &trees, &small };
+  const char* evalnames[] = { "eval", "eval-small" };
+  for (int k = 0; k < 2; ++k) {
+    PoolStats before = pool_stats();
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (Cell* tree : *workloads[k]) {
+      eval(tree);
+    }
+    chrono::steady_clock::time_point stop = chrono::steady_clock::now();
+    PoolStats after = pool_stats();
+    double ns = chrono::duration<double, nano>(stop - start).count();
+    cout << evalnames[k] << "\t" << workloads[k]->size() << " exprs\t" << ns / 1e6 << " ms\t"
+         << ns / workloads[k]->size() << " ns/expr\t"
+         << after.allocations - before.allocations << " allocations" << endl;
+  }
+}
+
+/**
+ * \brief Compare allocating and freeing cell-sized blocks through the
+ * global operator new and through the cell pools, then build and free
+ * cons lists and report the pool counters.
+ */
+void bench_alloc()
+{
+  const int n = 1000000;
+  vector<void*> blocks(n);
+  const char* names[] = { "malloc", "pool" };
+  for (int k = 0; k < 2; ++k) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int rep = 0; rep < 5; ++rep) {
+      for (int i = 0; i < n; ++i) {
+        blocks[i] = 0 == k ? ::operator new(sizeof(ConsCell)) : pool_allocate(sizeof(ConsCell));
+      }
+      for (int i = 0; i < n; ++i) {
+        if (0 == k) {
+          ::operator delete(blocks[i]);
+        } else {
+          pool_free(blocks[i]);
+        }
+      }
+    }
+    chrono::steady_clock::time_point stop = chrono::steady_clock::now();
+    double ns = chrono::duration<double, nano>(stop - start).count();
+    cout << names[k] << "\t" << 5 * n << " blocks\t" << ns / 1e6 << " ms\t"
+         << ns / (5 * n) << " ns/block" << endl;
+  }
+  PoolStats before = pool_stats();
+  for (int rep = 0; rep < 10; ++rep) {
+    Cell* list = nil;
+    for (int i = 0; i < 100000; ++i) {
+      list = cons(make_double(i), list);
+    }
+  }
+  gc_collect();
+  PoolStats after = pool_stats();
+  cout << "lists\t" << after.allocations - before.allocations << " allocations\t"
+       << after.frees - before.frees << " frees\t"
+       << after.slabs << " slabs" << endl;
+
+  // young cells stored into an old list survive their scope through
+  // the write barrier; the rest die with the arena
+  Arena arena;
+  Cell* old = nil;
+  for (int i = 0; i < 1000; ++i) {
+    old = cons(nil, old);
+  }
+  GcRoot keep(old);
+  GcStats gbefore = gc_stats();
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for (int rep = 0; rep < 10000; ++rep) {
+    ArenaScope scope(arena);
+    Cell* young = nil;
+    for (int i = 0; i < 1000; ++i) {
+      young = cons(make_double(i), young);
+    }
+    Cell* survivor = cons(make_int(rep), nil);
+    Cell* cell = old;
+    for (int i = 0; i < rep % 1000; ++i) {
+      cell = cdr(cell);
+    }
+    set_car(cell, survivor);
+  }
+  chrono::steady_clock::time_point stop = chrono::steady_clock::now();
+  GcStats gafter = gc_stats();
+  double us = chrono::duration<double, micro>(stop - start).count();
+  cout << "nursery\t" << gafter.evacuations - gbefore.evacuations << " evacuations\t"
+       << gafter.promoted - gbefore.promoted << " promoted\t"
+       << us / 1e3 << " ms\t" << us / 10000 << " us/scope" << endl;
+
+  // the same while collecting incrementally between scopes, with heap
+  // garbage to keep the collector busy
+  gc_set_pause_budget(0.05);
+  gbefore = gc_stats();
+  for (int rep = 0; rep < 10000; ++rep) {
+    gc_safepoint();
+    ArenaScope scope(arena);
+    {
+      HeapScope heap;
+      Cell* garbage = nil;
+      for (int i = 0; i < 1000; ++i) {
+        garbage = cons(make_double(i), garbage);
+      }
+    }
+    Cell* cell = old;
+    for (int i = 0; i < rep % 1000; ++i) {
+      cell = cdr(cell);
+    }
+    set_car(cell, cons(make_int(rep), nil));
+  }
+  gc_collect();
+  gc_set_pause_budget(0);
+  gafter = gc_stats();
+  int i = 0;
+  for (Cell* cell = old; !nullp(cell); cell = cdr(cell), ++i) {
+    if (get_int(car(car(cell))) % 1000 != i) {
+      cout << "incremental\tlost a cell" << endl;
+      exit(1);
+    }
+  }
+  cout << "incremental\t" << gafter.collections - gbefore.collections << " collections\t"
+       << gafter.slices - gbefore.slices << " slices\t"
+       << gafter.max_pause_ms << " ms max pause" << endl;
+}
+
+/**
+ * \brief Parse windows of expressions on fresh threads, the way
+ * --jobs does, dropping each window's trees before the next, and
+ * report the slabs held and the peak resident size as the windows add
+ * up.  Both should level off: the free cells and unused slabs of
+ * finished threads go to the depot for the next ones.
+ */
+void bench_jobs()
+{
+  const int jobs = 8;
+  const int per_thread = 4096;
+  const string sexpr = "(car (quote (alpha beta 1 (nested delta 2.5))))";
+  size_t first = 0;
+  for (int window = 1; window <= 64; ++window) {
+    vector<thread> workers;
+    for (int k = 0; k < jobs; ++k) {
+      workers.push_back(thread([&]() {
+        for (int i = 0; i < per_thread; ++i) {
+          parse(sexpr);
+        }
+      }));
+    }
+    for (thread& worker : workers) {
+      worker.join();
+    }
+    gc_collect();
+    PoolStats stats = pool_stats();
+    size_t held = stats.slabs - stats.released;
+    if (1 == window) {
+      first = held;
+    }
+    if (0 == (window & (window - 1))) {
+      struct rusage usage;
+      getrusage(RUSAGE_SELF, &usage);
+      cout << "jobs	" << window << " windows	" << held << " slabs held	"
+           << usage.ru_maxrss << " KB peak" << endl;
+    }
+  }
+  PoolStats stats = pool_stats();
+  if (stats.slabs - stats.released > 2 * first) {
+    cout << "jobs	slabs held keep growing" << endl;
+    exit(1);
+  }
+}
+
+/**
+ * \brief Time squaring random bignums of doubling size.  Past
+ * KARATSUBA_LIMBS each doubling should cost about 3x, not the 4x of
+ * the schoolbook method.
+ */
+void bench_bigint()
+{
+  uint64_t seed = 88172645463325252ull;
+  for (size_t n = 8; n <= 4096; n *= 2) {
+    vector<uint64_t> limbs(n);
+    for (uint64_t& limb : limbs) {
+      // xorshift, to fill every limb
+      seed ^= seed << 13;
+      seed ^= seed >> 7;
+      seed ^= seed << 17;
+      limb = seed;
+    }
+    BigInt a(false, limbs.data(), n);
+    int reps = static_cast<int>(max<size_t>(1, 1000000 / (n * n)));
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int rep = 0; rep < reps; ++rep) {
+      BigInt p = a;
+      big_mul(p, a);
+    }
+    chrono::steady_clock::time_point stop = chrono::steady_clock::now();
+    double ns = chrono::duration<double, nano>(stop - start).count() / reps;
+    cout << "square\t" << n << " limbs\t" << ns / 1e3 << " us" << endl;
+  }
+}
+
+/**
+ * \brief Compare looking up every element of a list by walking cdr
+ * chains with indexing a vector of the same elements.
+ */
+void bench_vector()
+{
+  for (int n = 1000; n <= 16000; n *= 2) {
+    Cell* list = parse(make_wide(n));
+    vector<Cell*> elems;
+    for (Cell* c = list; !nullp(c); c = cdr(c)) {
+      elems.push_back(car(c));
+    }
+    Cell* vec = make_vector(elems.data(), elems.size());
+    int64_t sum[2] = { 0, 0 };
+    double ns[2];
+    for (int k = 0; k < 2; ++k) {
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      for (int i = 0; i < n; ++i) {
+        Cell* c = list;
+        if (0 == k) {
+          for (int j = 0; j < i; ++j) {
+            c = cdr(c);
+          }
+          sum[k] += get_int(car(c));
+        } else {
+          sum[k] += get_int(vector_ref(vec, i));
+        }
+      }
+      chrono::steady_clock::time_point stop = chrono::steady_clock::now();
+      ns[k] = chrono::duration<double, nano>(stop - start).count();
+    }
+    cout << "index\t" << n << "\tlist " << ns[0] / n << " ns/lookup\tvector "
+         << ns[1] / n << " ns/lookup\t" << (sum[0] == sum[1] ? "ok" : "MISMATCH") << endl;
+  }
+}
+
+/**
+ * \brief Run the benchmark named by the first argument, or all of them.
+ */
+int main(int argc, char* argv[])
+{
+  bool all = argc < 2;
+  if (all || 0 == strcmp(argv[1], "parse")) {
+    bench_parse();
+  }
+  if (all || 0 == strcmp(argv[1], "scan")) {
+    bench_scan();
+  }
+  if (all || 0 == strcmp(argv[1], "dispatch")) {
+    bench_dispatch();
+  }
+  if (all || 0 == strcmp(argv[1], "alloc")) {
+    bench_alloc();
+  }
+  if (all || 0 == strcmp(argv[1], "jobs")) {
+    bench_jobs();
+  }
+  if (all || 0 == strcmp(argv[1], "bigint")) {
+    bench_bigint();
+  }
+  if (all || 0 == strcmp(argv[1], "vector")) {
+    bench_vector();
+  }
+  return 0;
+}
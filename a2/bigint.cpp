@@ -0,0 +1,361 @@
+/**
+ * \file bigint.cpp
+ *
+ * Implementation of arbitrary-precision integers.  Limb products and
+ * carries are computed in 128 bits.
+ */
+
+#include "bigint.hpp"
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+typedef vector<uint64_t> Limbs;
+typedef unsigned __int128 Wide;
+
+/**
+ * \brief The largest power of ten in a limb, for decimal conversion.
+ */
+const uint64_t TEN_19 = 10000000000000000000ull;
+
+/**
+ * \brief Drop leading zero limbs.
+ */
+void trim(Limbs& a)
+{
+  while (!a.empty() && 0 == a.back()) {
+    a.pop_back();
+  }
+}
+
+/**
+ * \brief The number of limbs of a without leading zeros.
+ */
+size_t length(const uint64_t* a, size_t n)
+{
+  while (n > 0 && 0 == a[n - 1]) {
+    --n;
+  }
+  return n;
+}
+
+/**
+ * \brief Compare trimmed magnitudes.
+ * \return Negative, zero or positive as a is less than, equal to or
+ * greater than b.
+ */
+int mag_compare(const Limbs& a, const Limbs& b)
+{
+  if (a.size() != b.size()) {
+    return a.size() < b.size() ? -1 : 1;
+  }
+  for (size_t i = a.size(); i-- > 0;) {
+    if (a[i] != b[i]) {
+      return a[i] < b[i] ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * \brief Add b, shifted left by offset limbs, to a.
+ */
+void mag_add(Limbs& a, const uint64_t* b, size_t nb, size_t offset = 0)
+{
+  if (a.size() < offset + nb) {
+    a.resize(offset + nb, 0);
+  }
+  uint64_t carry = 0;
+  for (size_t i = 0; i < nb; ++i) {
+    Wide t = static_cast<Wide>(a[offset + i]) + b[i] + carry;
+    a[offset + i] = static_cast<uint64_t>(t);
+    carry = static_cast<uint64_t>(t >> 64);
+  }
+  for (size_t i = offset + nb; 0 != carry; ++i) {
+    if (i == a.size()) {
+      a.push_back(carry);
+      break;
+    }
+    carry = (0 == ++a[i]) ? 1 : 0;
+  }
+}
+
+/**
+ * \brief Subtract b from a, which must be at least as large.
+ */
+void mag_sub(Limbs& a, const uint64_t* b, size_t nb)
+{
+  uint64_t borrow = 0;
+  for (size_t i = 0; i < a.size() && (i < nb || 0 != borrow); ++i) {
+    Wide t = static_cast<Wide>(a[i]) - (i < nb ? b[i] : 0) - borrow;
+    a[i] = static_cast<uint64_t>(t);
+    borrow = (0 != (t >> 64)) ? 1 : 0;
+  }
+  trim(a);
+}
+
+/**
+ * \brief Multiply a by m and add c, both single limbs.
+ */
+void mag_mul_add(Limbs& a, uint64_t m, uint64_t c)
+{
+  for (uint64_t& limb : a) {
+    Wide t = static_cast<Wide>(limb) * m + c;
+    limb = static_cast<uint64_t>(t);
+    c = static_cast<uint64_t>(t >> 64);
+  }
+  if (0 != c) {
+    a.push_back(c);
+  }
+}
+
+/**
+ * \brief Divide a by a single limb.
+ * \return The remainder.
+ */
+uint64_t mag_divmod(Limbs& a, uint64_t d)
+{
+  Wide rem = 0;
+  for (size_t i = a.size(); i-- > 0;) {
+    Wide cur = (rem << 64) | a[i];
+    a[i] = static_cast<uint64_t>(cur / d);
+    rem = cur % d;
+  }
+  trim(a);
+  return static_cast<uint64_t>(rem);
+}
+
+/**
+ * \brief Schoolbook multiplication into r, which holds na + nb zero
+ * limbs.
+ */
+void mul_school(const uint64_t* a, size_t na, const uint64_t* b, size_t nb, uint64_t* r)
+{
+  for (size_t i = 0; i < na; ++i) {
+    uint64_t carry = 0;
+    for (size_t j = 0; j < nb; ++j) {
+      Wide t = static_cast<Wide>(a[i]) * b[j] + r[i + j] + carry;
+      r[i + j] = static_cast<uint64_t>(t);
+      carry = static_cast<uint64_t>(t >> 64);
+    }
+    r[i + nb] = carry;
+  }
+}
+
+/**
+ * \brief Multiply magnitudes, by Karatsuba once both are long enough.
+ */
+Limbs mag_mul(const uint64_t* a, size_t na, const uint64_t* b, size_t nb)
+{
+  na = length(a, na);
+  nb = length(b, nb);
+  if (na < nb) {
+    swap(a, b);
+    swap(na, nb);
+  }
+  Limbs r;
+  if (0 == nb) {
+    return r;
+  }
+  if (nb < KARATSUBA_LIMBS) {
+    r.assign(na + nb, 0);
+    mul_school(a, na, b, nb, r.data());
+  } else if (2 * nb <= na) {
+    // too lopsided to split evenly: multiply b by slices of a its size
+    for (size_t i = 0; i < na; i += nb) {
+      Limbs p = mag_mul(a + i, min(nb, na - i), b, nb);
+      mag_add(r, p.data(), p.size(), i);
+    }
+  } else {
+    // with a = a1 B^k + a0 and b = b1 B^k + b0,
+    // a b = z2 B^2k + z1 B^k + z0 where z1 = (a1 + a0)(b1 + b0) - z2 - z0
+    size_t k = (na + 1) / 2;
+    Limbs z0 = mag_mul(a, k, b, k);
+    Limbs z2 = mag_mul(a + k, na - k, b + k, nb - k);
+    Limbs sa(a, a + k);
+    mag_add(sa, a + k, na - k);
+    Limbs sb(b, b + k);
+    mag_add(sb, b + k, nb - k);
+    Limbs z1 = mag_mul(sa.data(), sa.size(), sb.data(), sb.size());
+    mag_sub(z1, z0.data(), z0.size());
+    mag_sub(z1, z2.data(), z2.size());
+    r.swap(z0);
+    mag_add(r, z1.data(), z1.size(), k);
+    mag_add(r, z2.data(), z2.size(), 2 * k);
+  }
+  trim(r);
+  return r;
+}
+
+/**
+ * \brief Divide magnitudes.  Multi-limb divisors take one bit of the
+ * quotient per step, which is plenty for the rare division of two
+ * bignums.
+ */
+Limbs mag_div(const Limbs& n, const Limbs& d)
+{
+  Limbs q;
+  if (mag_compare(n, d) < 0) {
+    return q;
+  }
+  if (1 == d.size()) {
+    q = n;
+    mag_divmod(q, d[0]);
+    return q;
+  }
+  q.assign(n.size(), 0);
+  Limbs rem;
+  for (size_t bit = n.size() * 64; bit-- > 0;) {
+    // rem = 2 rem + the next bit of n
+    uint64_t carry = (n[bit / 64] >> (bit % 64)) & 1;
+    for (uint64_t& limb : rem) {
+      uint64_t top = limb >> 63;
+      limb = (limb << 1) | carry;
+      carry = top;
+    }
+    if (0 != carry) {
+      rem.push_back(carry);
+    }
+    if (mag_compare(rem, d) >= 0) {
+      mag_sub(rem, d.data(), d.size());
+      q[bit / 64] |= 1ull << (bit % 64);
+    }
+  }
+  trim(q);
+  return q;
+}
+
+}
+
+BigInt::BigInt(int64_t i) : negative(i < 0)
+{
+  // negate in unsigned arithmetic, which also covers INT64_MIN
+  uint64_t m = negative ? 0 - static_cast<uint64_t>(i) : static_cast<uint64_t>(i);
+  if (0 != m) {
+    mag.push_back(m);
+  }
+}
+
+BigInt::BigInt(bool negative, const uint64_t* limbs, size_t n)
+  : negative(negative), mag(limbs, limbs + length(limbs, n))
+{
+  if (mag.empty()) {
+    this->negative = false;
+  }
+}
+
+bool big_to_int64(const BigInt& a, int64_t& v)
+{
+  if (a.mag.size() > 1) {
+    return false;
+  }
+  uint64_t m = a.mag.empty() ? 0 : a.mag[0];
+  if (m > (a.negative ? 1ull << 63 : static_cast<uint64_t>(INT64_MAX))) {
+    return false;
+  }
+  v = static_cast<int64_t>(a.negative ? 0 - m : m);
+  return true;
+}
+
+double big_to_double(const BigInt& a)
+{
+  double d = 0;
+  for (size_t i = a.mag.size(); i-- > 0;) {
+    d = d * 18446744073709551616.0 + static_cast<double>(a.mag[i]);
+  }
+  return a.negative ? -d : d;
+}
+
+void big_negate(BigInt& a)
+{
+  a.negative = !a.negative && !a.mag.empty();
+}
+
+void big_add(BigInt& acc, const BigInt& x)
+{
+  if (acc.negative == x.negative) {
+    mag_add(acc.mag, x.mag.data(), x.mag.size());
+    return;
+  }
+  // the signs differ: take the smaller magnitude from the larger
+  if (mag_compare(acc.mag, x.mag) >= 0) {
+    mag_sub(acc.mag, x.mag.data(), x.mag.size());
+  } else {
+    Limbs m = x.mag;
+    mag_sub(m, acc.mag.data(), acc.mag.size());
+    acc.mag.swap(m);
+    acc.negative = x.negative;
+  }
+  if (acc.mag.empty()) {
+    acc.negative = false;
+  }
+}
+
+void big_mul(BigInt& acc, const BigInt& x)
+{
+  acc.mag = mag_mul(acc.mag.data(), acc.mag.size(), x.mag.data(), x.mag.size());
+  acc.negative = acc.negative != x.negative && !acc.mag.empty();
+}
+
+BigInt big_div(const BigInt& n, const BigInt& d)
+{
+  BigInt q;
+  q.mag = mag_div(n.mag, d.mag);
+  q.negative = n.negative != d.negative && !q.mag.empty();
+  return q;
+}
+
+string big_to_string(const BigInt& a)
+{
+  if (a.mag.empty()) {
+    return "0";
+  }
+  // peel off 19 digits at a time, least significant first
+  Limbs m = a.mag;
+  vector<uint64_t> chunks;
+  while (!m.empty()) {
+    chunks.push_back(mag_divmod(m, TEN_19));
+  }
+  string s = a.negative ? "-" : "";
+  s += to_string(chunks.back());
+  for (size_t i = chunks.size() - 1; i-- > 0;) {
+    string digits = to_string(chunks[i]);
+    s.append(19 - digits.size(), '0');
+    s += digits;
+  }
+  return s;
+}
+
+bool big_parse(string_view s, BigInt& a)
+{
+  size_t i = 0;
+  bool negative = false;
+  if (!s.empty() && ('-' == s[0] || '+' == s[0])) {
+    negative = '-' == s[0];
+    ++i;
+  }
+  if (i == s.size()) {
+    return false;
+  }
+  // take 19 digits at a time, the first chunk being the short one
+  Limbs m;
+  size_t len = (s.size() - i) % 19;
+  for (len = (0 == len) ? 19 : len; i < s.size(); i += len, len = 19) {
+    uint64_t chunk = 0;
+    uint64_t scale = 1;
+    for (size_t j = i; j < i + len; ++j) {
+      if (s[j] < '0' || s[j] > '9') {
+        return false;
+      }
+      chunk = chunk * 10 + (s[j] - '0');
+      scale *= 10;
+    }
+    mag_mul_add(m, scale, chunk);
+  }
+  trim(m);
+  a.mag.swap(m);
+  a.negative = negative && !a.mag.empty();
+  return true;
+}
@@ -0,0 +1,112 @@
+/**
+ * \file bigint.hpp
+ *
+ * Arbitrary-precision integer arithmetic for the bignum cells.  A value
+ * is a sign and a magnitude, the magnitude a little-endian vector of
+ * 64-bit limbs.
+ */
+
+#ifndef BIGINT_HPP
+#define BIGINT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * \brief Size, in limbs, of the shorter factor from which
+ * multiplication switches from the schoolbook method to Karatsuba.
+ */
+const size_t KARATSUBA_LIMBS = 32;
+
+/**
+ * \brief An integer of any size, used to compute exact results before
+ * they are stored in a cell.  The magnitude has no leading zero limbs,
+ * so zero is the empty vector, and zero is never negative.
+ */
+struct BigInt
+{
+  bool negative;
+  std::vector<uint64_t> mag;
+
+  /**
+   * \brief Build zero.
+   */
+  BigInt() : negative(false) {}
+
+  /**
+   * \brief Build the value of an int.
+   * \param i The value.
+   */
+  explicit BigInt(int64_t i);
+
+  /**
+   * \brief Build a value from its sign and magnitude.
+   * \param negative The sign.
+   * \param limbs The magnitude, little-endian.
+   * \param n The number of limbs.
+   */
+  BigInt(bool negative, const uint64_t* limbs, size_t n);
+};
+
+/**
+ * \brief Convert to an int if the value fits.
+ * \param a The value.
+ * \param v Set to the value of a if it fits.
+ * \return True iff a fits in an int64_t.
+ */
+bool big_to_int64(const BigInt& a, int64_t& v);
+
+/**
+ * \brief Convert to the nearest double, or an infinity if too large.
+ * \param a The value.
+ * \return The double.
+ */
+double big_to_double(const BigInt& a);
+
+/**
+ * \brief Negate in place.
+ * \param a The value.
+ */
+void big_negate(BigInt& a);
+
+/**
+ * \brief Add x to acc.
+ * \param acc The running sum.
+ * \param x The addend.
+ */
+void big_add(BigInt& acc, const BigInt& x);
+
+/**
+ * \brief Multiply acc by x.
+ * \param acc The running product.
+ * \param x The factor.
+ */
+void big_mul(BigInt& acc, const BigInt& x);
+
+/**
+ * \brief Divide, truncating toward zero like int division.
+ * \param n The dividend.
+ * \param d The divisor, which must not be zero.
+ * \return The quotient.
+ */
+BigInt big_div(const BigInt& n, const BigInt& d);
+
+/**
+ * \brief Format in decimal.
+ * \param a The value.
+ * \return The digits, after a minus sign if a is negative.
+ */
+std::string big_to_string(const BigInt& a);
+
+/**
+ * \brief Parse a decimal integer literal with an optional sign.
+ * \param s The literal.
+ * \param a Set to the value.
+ * \return False if s is not an integer literal.
+ */
+bool big_parse(std::string_view s, BigInt& a);
+
+#endif // BIGINT_HPP
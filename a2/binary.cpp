@@ -0,0 +1,315 @@
+/**
+ * \file binary.cpp
+ *
+ * Implementation of the precompiled binary parse-tree format.
+ */
+
+#include "binary.hpp"
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+/**
+ * \brief The magic bytes opening every binary file.  The leading NUL
+ * can never start a text source file.
+ */
+static const char BINARY_MAGIC[] = { '\0', 'S', 'C', 'M', 'B' };
+
+/**
+ * \brief The format version written after the magic.
+ */
+static const char BINARY_VERSION = 1;
+
+/**
+ * \brief Tag bytes introducing each encoded cell.
+ */
+enum BinaryTag {
+  TAG_NIL = 0,
+  TAG_INT = 1,
+  TAG_DOUBLE = 2,
+  TAG_SYMBOL = 3,
+  TAG_LIST = 4,
+  TAG_BIGINT = 5
+};
+
+/**
+ * \brief Append an unsigned LEB128 varint.
+ * \param out The output bytes.
+ * \param n The value.
+ */
+static void put_varint(string& out, uint64_t n)
+{
+  while (n >= 0x80) {
+    out += static_cast<char>((n & 0x7f) | 0x80);
+    n >>= 7;
+  }
+  out += static_cast<char>(n);
+}
+
+/**
+ * \brief Read an unsigned LEB128 varint.
+ * \param br The reader.
+ * \return The value.
+ */
+static uint64_t get_varint(BinaryReader& br)
+{
+  uint64_t n = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (br.cur >= br.end) {
+      break;
+    }
+    unsigned char byte = *br.cur++;
+    n |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return n;
+    }
+  }
+  throw runtime_error("ERROR: Corrupt binary file.\n");
+}
+
+bool is_binary(const char* buf, size_t size)
+{
+  return size >= sizeof(BINARY_MAGIC)
+    && 0 == memcmp(buf, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+}
+
+/**
+ * \brief Encode a cell that is not a non-empty list.
+ * \param bw The writer.
+ * \param c The cell.
+ */
+static void write_atom(BinaryWriter& bw, Cell* const c)
+{
+  string& out = bw.trees;
+  if (nullp(c)) {
+    out += static_cast<char>(TAG_NIL);
+  } else if (intp(c)) {
+    // zigzag keeps small negative numbers short
+    int64_t i = get_int(c);
+    out += static_cast<char>(TAG_INT);
+    put_varint(out, (static_cast<uint64_t>(i) << 1) ^ static_cast<uint64_t>(i >> 63));
+  } else if (bigintp(c)) {
+    // the limb count with the sign in its low bit, then the limbs
+    const BigIntCell* b = static_cast<const BigIntCell*>(c);
+    out += static_cast<char>(TAG_BIGINT);
+    put_varint(out, (static_cast<uint64_t>(b->size()) << 1) | (b->is_negative() ? 1 : 0));
+    for (size_t k = 0; k < b->size(); ++k) {
+      for (int i = 0; i < 8; ++i) {
+        out += static_cast<char>(b->limbs()[k] >> (8 * i));
+      }
+    }
+  } else if (doublep(c)) {
+    double d = get_double(c);
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    out += static_cast<char>(TAG_DOUBLE);
+    for (int i = 0; i < 8; ++i) {
+      out += static_cast<char>(bits >> (8 * i));
+    }
+  } else {
+    // symbols are interned, so the cell itself identifies the name
+    unordered_map<const Cell*, size_t>::iterator it = bw.symbolindex.find(c);
+    size_t index;
+    if (it == bw.symbolindex.end()) {
+      index = bw.symbols.size();
+      bw.symbolindex[c] = index;
+      bw.symbols.push_back(get_symbol(c));
+    } else {
+      index = it->second;
+    }
+    out += static_cast<char>(TAG_SYMBOL);
+    put_varint(out, index);
+  }
+}
+
+/**
+ * \brief Encode one top-level tree.
+ *
+ * Lists are written with an explicit stack holding the rest of every
+ * list still open, so nesting depth is not limited by the C++ stack.
+ *
+ * \param bw The writer.
+ * \param c The root of the tree.
+ */
+void write_tree(BinaryWriter& bw, Cell* const c)
+{
+  vector<Cell*> open;
+  Cell* next = c;
+  while (true) {
+    if (listp(next) && !nullp(next)) {
+      // a list: its element count, then the elements and the tail
+      size_t n = 0;
+      for (Cell* cur = next; listp(cur) && !nullp(cur); cur = cdr(cur)) {
+        ++n;
+      }
+      bw.trees += static_cast<char>(TAG_LIST);
+      put_varint(bw.trees, n);
+      open.push_back(next);
+    } else {
+      write_atom(bw, next);
+    }
+    // move on to the next element of the innermost open list
+    while (true) {
+      if (open.empty()) {
+        return;
+      }
+      Cell* rest = open.back();
+      if (listp(rest) && !nullp(rest)) {
+        next = car(rest);
+        open.back() = cdr(rest);
+        break;
+      }
+      open.pop_back();
+      write_atom(bw, rest);
+    }
+  }
+}
+
+void write_binary(const BinaryWriter& bw, ostream& os)
+{
+  string header(BINARY_MAGIC, sizeof(BINARY_MAGIC));
+  header += BINARY_VERSION;
+  put_varint(header, bw.symbols.size());
+  for (size_t i = 0; i < bw.symbols.size(); ++i) {
+    put_varint(header, bw.symbols[i].size());
+    header += bw.symbols[i];
+  }
+  os.write(header.data(), header.size());
+  os.write(bw.trees.data(), bw.trees.size());
+}
+
+void open_binary(BinaryReader& br, const char* buf, size_t size)
+{
+  if (!is_binary(buf, size) || size <= sizeof(BINARY_MAGIC)
+      || BINARY_VERSION != buf[sizeof(BINARY_MAGIC)]) {
+    throw runtime_error("ERROR: Not a binary file of a supported version.\n");
+  }
+  br.cur = buf + sizeof(BINARY_MAGIC) + 1;
+  br.end = buf + size;
+  uint64_t count = get_varint(br);
+  br.symbols.clear();
+  for (uint64_t i = 0; i < count; ++i) {
+    uint64_t length = get_varint(br);
+    if (length > static_cast<uint64_t>(br.end - br.cur)) {
+      throw runtime_error("ERROR: Corrupt binary file.\n");
+    }
+    // interned once here, so each occurrence is a plain load
+    br.symbols.push_back(make_symbol(string_view(br.cur, length)));
+    br.cur += length;
+  }
+}
+
+/**
+ * \brief Rebuild a cell that is not a non-empty list.
+ * \param br The reader, just past the tag byte.
+ * \param tag The tag byte.
+ * \return The rebuilt cell.
+ */
+static Cell* read_atom(BinaryReader& br, char tag)
+{
+  switch (tag) {
+  case TAG_NIL:
+    return nil;
+  case TAG_INT: {
+    uint64_t z = get_varint(br);
+    return make_int(static_cast<int64_t>(z >> 1) ^ -static_cast<int64_t>(z & 1));
+  }
+  case TAG_DOUBLE: {
+    if (br.end - br.cur < 8) {
+      throw runtime_error("ERROR: Corrupt binary file.\n");
+    }
+    uint64_t bits = 0;
+    for (int i = 0; i < 8; ++i) {
+      bits |= static_cast<uint64_t>(static_cast<unsigned char>(br.cur[i])) << (8 * i);
+    }
+    br.cur += 8;
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return make_double(d);
+  }
+  case TAG_BIGINT: {
+    uint64_t header = get_varint(br);
+    uint64_t n = header >> 1;
+    if (static_cast<uint64_t>(br.end - br.cur) / 8 < n) {
+      throw runtime_error("ERROR: Corrupt binary file.\n");
+    }
+    vector<uint64_t> limbs(n, 0);
+    for (uint64_t k = 0; k < n; ++k) {
+      for (int i = 0; i < 8; ++i) {
+        limbs[k] |= static_cast<uint64_t>(static_cast<unsigned char>(br.cur[i])) << (8 * i);
+      }
+      br.cur += 8;
+    }
+    return make_integer(BigInt(0 != (header & 1), limbs.data(), n));
+  }
+  case TAG_SYMBOL: {
+    uint64_t index = get_varint(br);
+    if (index >= br.symbols.size()) {
+      throw runtime_error("ERROR: Corrupt binary file.\n");
+    }
+    return br.symbols[index];
+  }
+  default:
+    throw runtime_error("ERROR: Corrupt binary file.\n");
+  }
+}
+
+/**
+ * \brief Rebuild the next tree (throws runtime_error if the file is
+ * malformed).
+ *
+ * The cells of every list still open are kept on one explicit stack,
+ * and each list is consed together from the back once its tail has
+ * been read, so nesting depth is not limited by the C++ stack.
+ *
+ * \param br The reader, left just past the tree.
+ * \return The root of the rebuilt tree.
+ */
+Cell* read_tree(BinaryReader& br)
+{
+  struct OpenList
+  {
+    // elements and tail still to be read
+    uint64_t remaining;
+    // where the list's cells start in cells
+    size_t first;
+  };
+  vector<OpenList> open;
+  vector<Cell*> cells;
+  while (true) {
+    if (br.cur >= br.end) {
+      throw runtime_error("ERROR: Corrupt binary file.\n");
+    }
+    char tag = *br.cur++;
+    if (TAG_LIST == tag) {
+      uint64_t n = get_varint(br);
+      if (n > static_cast<uint64_t>(br.end - br.cur)) {
+        throw runtime_error("ERROR: Corrupt binary file.\n");
+      }
+      OpenList list = { n + 1, cells.size() };
+      open.push_back(list);
+      continue;
+    }
+    Cell* done = read_atom(br, tag);
+    // hand the cell to the innermost open list, closing every list it
+    // completes
+    while (true) {
+      if (open.empty()) {
+        return done;
+      }
+      cells.push_back(done);
+      if (--open.back().remaining > 0) {
+        break;
+      }
+      size_t first = open.back().first;
+      open.pop_back();
+      done = cells.back();
+      for (size_t i = cells.size() - 1; i > first; --i) {
+        done = cons(cells[i - 1], done);
+      }
+      cells.resize(first);
+    }
+  }
+}
@@ -0,0 +1,118 @@
+/**
+ * \file binary.hpp
+ *
+ * Encapsulates the interface for the precompiled binary parse-tree
+ * format (.scmb), which stores already parsed top-level expressions so
+ * that repeated batch runs can rebuild the trees without any text
+ * parsing.
+ *
+ * Layout: the magic bytes "\0SCMB" and a version byte, a symbol table
+ * (a varint count, then each name as a varint length and its bytes),
+ * then the trees one after another up to the end of the file.  Each
+ * tree is a tag byte followed by its payload: nothing for nil, a
+ * zigzag varint for an int, 8 little-endian bytes for a double, a
+ * varint symbol table index for a symbol, and for a list a varint
+ * element count, the elements, and the tail.
+ */
+
+#ifndef BINARY_HPP
+#define BINARY_HPP
+
+#include "cons.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+
+/**
+ * \brief Encoder collecting trees into the binary format.
+ */
+struct BinaryWriter
+{
+  /**
+   * \brief Index of every symbol name in the symbol table.
+   */
+  std::unordered_map<const Cell*, size_t> symbolindex;
+
+  /**
+   * \brief Symbol names in table order.
+   */
+  std::vector<std::string> symbols;
+
+  /**
+   * \brief The encoded trees.
+   */
+  std::string trees;
+};
+
+/**
+ * \brief Decoder walking the trees of a binary file in place.
+ */
+struct BinaryReader
+{
+  /**
+   * \brief The next unread byte.
+   */
+  const char* cur;
+
+  /**
+   * \brief One past the last byte.
+   */
+  const char* end;
+
+  /**
+   * \brief The symbol table of the file, interned when it is opened.
+   */
+  std::vector<Cell*> symbols;
+};
+
+/**
+ * \brief Check whether a buffer starts with the binary format magic.
+ * \param buf The first byte of the buffer.
+ * \param size The number of bytes in the buffer.
+ * \return True iff buf holds a binary file.
+ */
+bool is_binary(const char* buf, size_t size);
+
+/**
+ * \brief Encode one top-level tree.
+ * \param bw The writer.
+ * \param c The root of the tree.
+ */
+void write_tree(BinaryWriter& bw, Cell* const c);
+
+/**
+ * \brief Write the header, symbol table and encoded trees.
+ * \param bw The writer.
+ * \param os The output stream.
+ */
+void write_binary(const BinaryWriter& bw, std::ostream& os);
+
+/**
+ * \brief Read the header and symbol table of a binary file (throws
+ * runtime_error if the file is malformed).
+ * \param br The reader, left at the first tree.
+ * \param buf The first byte of the file.
+ * \param size The number of bytes in the file.
+ */
+void open_binary(BinaryReader& br, const char* buf, size_t size);
+
+/**
+ * \brief Check whether another tree follows.
+ * \param br The reader.
+ * \return True iff there is another tree to read.
+ */
+inline bool more_trees(const BinaryReader& br)
+{
+  return br.cur < br.end;
+}
+
+/**
+ * \brief Rebuild the next tree (throws runtime_error if the file is
+ * malformed).
+ * \param br The reader, left just past the tree.
+ * \return The root of the rebuilt tree.
+ */
+Cell* read_tree(BinaryReader& br);
+
+#endif // BINARY_HPP
@@ -0,0 +1,108 @@
+/**
+ * \file cache.cpp
+ *
+ * Implementation of the parse-result cache.
+ */
+
+#include "cache.hpp"
+
+using namespace std;
+
+uint64_t hash_text(string_view text)
+{
+  uint64_t h = 14695981039346656037ull;
+  for (size_t i = 0; i < text.size(); ++i) {
+    h ^= static_cast<unsigned char>(text[i]);
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+/**
+ * \brief Build an empty cache.
+ * \param capacity The maximum number of trees kept.
+ */
+ParseCache::ParseCache(size_t capacity)
+  : capacity(capacity), nhits(0), nmisses(0),
+    roots([this](vector<Cell**>& slots) {
+      for (Entry& e : entries) {
+        slots.push_back(&e.tree);
+      }
+    })
+{
+}
+
+/**
+ * \brief Look up the tree parsed from text, counting a hit or a miss.
+ * \param text The expression text.
+ * \return The cached tree, or NULL on a miss.
+ */
+Cell* ParseCache::find(string_view text)
+{
+  unordered_map<uint64_t, list<Entry>::iterator>::iterator it
+    = index.find(hash_text(text));
+  if (it == index.end() || it->second->text != text) {
+    ++nmisses;
+    return NULL;
+  }
+  ++nhits;
+  // move the entry to the front
+  entries.splice(entries.begin(), entries, it->second);
+  return it->second->tree;
+}
+
+/**
+ * \brief Remember the tree parsed from text, evicting the least
+ * recently used tree if the cache is full.
+ * \param text The expression text.
+ * \param tree The parse tree.
+ */
+void ParseCache::insert(string_view text, Cell* tree)
+{
+  if (0 == capacity) {
+    return;
+  }
+  if (gc_marking && !immediatep(tree)) {
+    gc_shade(tree);
+  }
+  uint64_t hash = hash_text(text);
+  unordered_map<uint64_t, list<Entry>::iterator>::iterator it = index.find(hash);
+  if (it != index.end()) {
+    // a colliding text takes over the slot
+    entries.erase(it->second);
+    index.erase(it);
+  } else if (entries.size() >= capacity) {
+    index.erase(entries.back().hash);
+    entries.pop_back();
+  }
+  Entry e = { hash, string(text), tree };
+  entries.push_front(e);
+  index[hash] = entries.begin();
+}
+
+/**
+ * \brief Accessor.
+ * \return The number of lookups that found a tree.
+ */
+size_t ParseCache::hits() const
+{
+  return nhits;
+}
+
+/**
+ * \brief Accessor.
+ * \return The number of lookups that found nothing.
+ */
+size_t ParseCache::misses() const
+{
+  return nmisses;
+}
+
+/**
+ * \brief Accessor.
+ * \return The number of trees currently cached.
+ */
+size_t ParseCache::size() const
+{
+  return entries.size();
+}
@@ -0,0 +1,112 @@
+/**
+ * \file cache.hpp
+ *
+ * Encapsulates the interface for the parse-result cache, a bounded
+ * least-recently-used map from the text of a top-level expression to
+ * its parse tree, so that repeated expressions skip parsing.
+ */
+
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include "cons.hpp"
+#include "gc.hpp"
+#include <cstdint>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/**
+ * \brief Hash the bytes of an expression (64-bit FNV-1a).
+ * \param text The expression text.
+ * \return The hash value.
+ */
+uint64_t hash_text(std::string_view text);
+
+/**
+ * \class ParseCache.
+ * \brief Bounded LRU cache of parse trees keyed by expression text.
+ *
+ * Cached trees are shared by every later evaluation of the same text,
+ * so they must be treated as immutable.  The cached trees must be in
+ * the old generation (see promote()); they are collection roots until
+ * they are evicted.
+ */
+class ParseCache
+{
+public:
+
+  /**
+   * \brief Build an empty cache.
+   * \param capacity The maximum number of trees kept.
+   */
+  ParseCache(size_t capacity);
+
+  /**
+   * \brief Look up the tree parsed from text, counting a hit or a miss.
+   * \param text The expression text.
+   * \return The cached tree, or NULL on a miss.
+   */
+  Cell* find(std::string_view text);
+
+  /**
+   * \brief Remember the tree parsed from text, evicting the least
+   * recently used tree if the cache is full.
+   * \param text The expression text.
+   * \param tree The parse tree.
+   */
+  void insert(std::string_view text, Cell* tree);
+
+  /**
+   * \brief Accessor.
+   * \return The number of lookups that found a tree.
+   */
+  size_t hits() const;
+
+  /**
+   * \brief Accessor.
+   * \return The number of lookups that found nothing.
+   */
+  size_t misses() const;
+
+  /**
+   * \brief Accessor.
+   * \return The number of trees currently cached.
+   */
+  size_t size() const;
+
+private:
+
+  /**
+   * \brief A cached tree with the text it was parsed from, kept to
+   * rule out hash collisions.
+   */
+  struct Entry
+  {
+    uint64_t hash;
+    std::string text;
+    Cell* tree;
+  };
+
+  size_t capacity;
+  size_t nhits;
+  size_t nmisses;
+
+  /**
+   * \brief Entries from most to least recently used.
+   */
+  std::list<Entry> entries;
+
+  /**
+   * \brief Entry of every cached hash.
+   */
+  std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+
+  /**
+   * \brief Keeps the cached trees alive across collections.
+   */
+  GcScanner roots;
+};
+
+#endif // CACHE_HPP
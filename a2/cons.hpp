@@ -10,68 +10,346 @@
 #define CONS_HPP
 
 #include "Cell.hpp"
+#include "bigint.hpp"
+#include "intern.hpp"
+#include "hashcons.hpp"
+#include "gc.hpp"
+#include "pool.hpp"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <string>
 #include <iostream>
+#include <stdexcept>
 
 /**
  * \brief The null pointer value.
  */
 extern Cell* const nil;
 
+#ifdef NAN_BOXING
+
+/*
+ * NaN-boxed representation: every value is one 64-bit word.
+ *
+ *   0x0000 xxxx xxxx xxxx  pointer to a cell (symbols, conses, nil)
+ *   0x0002 ... 0xFFFC ...  double, stored as its bits plus 2^49
+ *   0xFFFE 0000 iiii iiii  int
+ *
+ * Pointers are left unchanged so the cell hierarchy still works on
+ * them directly.  Offsetting the double bits moves every double,
+ * including infinities and the one canonical NaN, out of the pointer
+ * range and below the int tag.
+ */
+static_assert(sizeof(Cell*) == 8, "NaN boxing needs 64-bit pointers");
+
 /**
- * \brief Make an int cell.
- * \param i The initial int value to be stored in the new cell.
+ * \brief Tag bits that mark an immediate int.
+ */
+const uint64_t FIXNUM_TAG = 0xFFFE000000000000ull;
+
+/**
+ * \brief Offset added to the bits of an immediate double.
+ */
+const uint64_t FLONUM_OFFSET = 1ull << 49;
+
+/**
+ * \brief Smallest int that fits in an immediate fixnum.
+ */
+const int64_t FIXNUM_MIN = INT32_MIN;
+
+/**
+ * \brief Largest int that fits in an immediate fixnum.
  */
-inline Cell* make_int(const int i)
+const int64_t FIXNUM_MAX = INT32_MAX;
+
+/**
+ * \brief Check if c is an immediate fixnum, i.e. an int stored in the
+ * word itself rather than a pointer to a cell.
+ * \return True iff c is a fixnum.
+ */
+inline bool fixnump(const Cell* const c)
 {
-  return new IntCell(i);
+  return (reinterpret_cast<uint64_t>(c) & FIXNUM_TAG) == FIXNUM_TAG;
+}
+
+/**
+ * \brief Check if c is an immediate double.
+ * \return True iff c is a flonum.
+ */
+inline bool flonump(const Cell* const c)
+{
+  return reinterpret_cast<uint64_t>(c) >= FLONUM_OFFSET && !fixnump(c);
+}
+
+/**
+ * \brief Check if c holds its value directly instead of pointing to a
+ * cell, so it must not be dereferenced.
+ * \return True iff c is an immediate value.
+ */
+inline bool immediatep(const Cell* const c)
+{
+  return reinterpret_cast<uint64_t>(c) >= FLONUM_OFFSET;
 }
 
 /**
- * \brief Make a double cell.
+ * \brief Decode a fixnum (c must be a fixnum).
+ * \return The int stored in c.
+ */
+inline int64_t fixnum_value(const Cell* const c)
+{
+  return static_cast<int32_t>(reinterpret_cast<uint64_t>(c));
+}
+
+/**
+ * \brief Encode an int in the fixnum range as a fixnum.
+ * \return The fixnum holding i.
+ */
+inline Cell* make_fixnum(const int64_t i)
+{
+  return reinterpret_cast<Cell*>(FIXNUM_TAG | static_cast<uint32_t>(i));
+}
+
+/**
+ * \brief Decode a flonum (c must be a flonum).
+ * \return The double stored in c.
+ */
+inline double flonum_value(const Cell* const c)
+{
+  uint64_t bits = reinterpret_cast<uint64_t>(c) - FLONUM_OFFSET;
+  double d;
+  std::memcpy(&d, &bits, sizeof d);
+  return d;
+}
+
+/**
+ * \brief Make a double cell.  Doubles are encoded directly in the
+ * returned word and allocate nothing.
  * \param d The initial double value to be stored in the new cell.
  */
 inline Cell* make_double(const double d)
 {
-  return new DoubleCell(d);
+  uint64_t bits = 0x7FF8000000000000ull;
+  if (d == d) {
+    std::memcpy(&bits, &d, sizeof bits);
+  }
+  return reinterpret_cast<Cell*>(bits + FLONUM_OFFSET);
+}
+
+#else
+
+/**
+ * \brief Smallest int that fits in an immediate fixnum.
+ */
+const intptr_t FIXNUM_MIN = INTPTR_MIN >> 1;
+
+/**
+ * \brief Largest int that fits in an immediate fixnum.
+ */
+const intptr_t FIXNUM_MAX = INTPTR_MAX >> 1;
+
+/**
+ * \brief Check if c is an immediate fixnum, i.e. an int stored in the
+ * pointer word itself with the low bit set, rather than a pointer to a
+ * cell.  Cells are at least 2-byte aligned, so real pointers never have
+ * the low bit set.
+ * \return True iff c is a fixnum.
+ */
+inline bool fixnump(const Cell* const c)
+{
+  return (reinterpret_cast<uintptr_t>(c) & 1) != 0;
+}
+
+/**
+ * \brief Check if c is an immediate double.  Doubles are always boxed
+ * without NaN boxing.
+ * \return False.
+ */
+inline bool flonump(const Cell* const c)
+{
+  return false;
 }
 
 /**
- * \brief Make a double cell.
+ * \brief Check if c holds its value directly instead of pointing to a
+ * cell, so it must not be dereferenced.
+ * \return True iff c is an immediate value.
+ */
+inline bool immediatep(const Cell* const c)
+{
+  return fixnump(c);
+}
+
+/**
+ * \brief Decode a fixnum (c must be a fixnum).
+ * \return The int stored in c.
+ */
+inline int64_t fixnum_value(const Cell* const c)
+{
+  return reinterpret_cast<intptr_t>(c) >> 1;
+}
+
+/**
+ * \brief Encode an int in the fixnum range as a fixnum.
+ * \return The fixnum holding i.
+ */
+inline Cell* make_fixnum(const int64_t i)
+{
+  return reinterpret_cast<Cell*>((static_cast<uintptr_t>(i) << 1) | 1);
+}
+
+/**
+ * \brief Decode a flonum.  Never called without NaN boxing.
+ * \return 0.0.
+ */
+inline double flonum_value(const Cell* const c)
+{
+  return 0.0;
+}
+
+/**
+ * \brief Smallest integral double with a shared cell.
+ */
+const int SMALL_DOUBLE_MIN = -128;
+
+/**
+ * \brief Largest integral double with a shared cell.
+ */
+const int SMALL_DOUBLE_MAX = 1023;
+
+/**
+ * \brief Shared immutable cells for the integral doubles from
+ * SMALL_DOUBLE_MIN to SMALL_DOUBLE_MAX, 0.0 among them, so the most
+ * common results allocate nothing.  They are permanent cells, filled
+ * during static initialization.
+ */
+extern Cell* small_doubles[SMALL_DOUBLE_MAX - SMALL_DOUBLE_MIN + 1];
+
+/**
+ * \brief Make a double cell: a shared one for small integral values,
+ * the canonical one while hash-consing, or else a new one.
  * \param d The initial double value to be stored in the new cell.
  */
+inline Cell* make_double(const double d)
+{
+  if (d >= SMALL_DOUBLE_MIN && d <= SMALL_DOUBLE_MAX) {
+    int i = static_cast<int>(d);
+    // -0.0 differs from 0.0 in its bits, so it gets a cell of its own
+    if (i == d && (0 != i || !std::signbit(d))) {
+      return small_doubles[i - SMALL_DOUBLE_MIN];
+    }
+  }
+  if (hash_consing) {
+    return hash_double(d);
+  }
+  return new DoubleCell(d);
+}
+
+#endif
+
+/**
+ * \brief Make an int cell.  Ints in the fixnum range are encoded
+ * directly in the returned word and allocate nothing; others are boxed,
+ * in the canonical cell while hash-consing.
+ * \param i The initial int value to be stored in the new cell.
+ */
+inline Cell* make_int(const int64_t i)
+{
+  if (i >= FIXNUM_MIN && i <= FIXNUM_MAX) {
+    return make_fixnum(i);
+  }
+  if (hash_consing) {
+    return hash_int(i);
+  }
+  return new IntCell(i);
+}
+
+/**
+ * \brief Make a bignum cell.  A magnitude longer than the cell holds
+ * in place is freed by the destructor, which arena cells never run, so
+ * such cells always go to the heap.
+ * \param negative The sign.
+ * \param limbs The magnitude, little-endian, without leading zeros.
+ * \param n The number of limbs, at least one.
+ */
+inline Cell* make_bigint(const bool negative, const uint64_t* const limbs, const size_t n)
+{
+  if (n <= 2) {
+    return new BigIntCell(negative, limbs, n);
+  }
+  HeapScope heap;
+  return new BigIntCell(negative, limbs, n);
+}
+
+/**
+ * \brief Make the cell of an exact integer result: an int cell if it
+ * fits in int64_t, else a bignum cell.
+ * \param a The value.
+ */
+inline Cell* make_integer(const BigInt& a)
+{
+  int64_t i;
+  if (big_to_int64(a, i)) {
+    return make_int(i);
+  }
+  return make_bigint(a.negative, a.mag.data(), a.mag.size());
+}
+
+/**
+ * \brief Make a number cell: an int cell if is_int and d fits in an
+ * int64_t, else a double cell.
+ * \param is_int Whether d is the value of an int expression.
+ * \param d The value.
+ */
 inline Cell* make_num(const bool is_int, const double d)
 {
-  if (is_int) return new IntCell((int)d);
-  else return new DoubleCell(d);
+  // 2^63 is exact as a double; -2^63 is the smallest int64_t
+  if (is_int && d >= -9223372036854775808.0 && d < 9223372036854775808.0) {
+    return make_int(static_cast<int64_t>(d));
+  }
+  return make_double(d);
 }
 
 /**
- * \brief Make a symbol cell.
- * \param s The initial symbol name to be stored in the new cell.
+ * \brief Make a symbol cell.  Symbols are interned: every call with
+ * the same name returns the same cell, so symbols can be compared
+ * with ==, and the cell must not be freed.
+ * \param s The symbol name.
  */
-inline Cell* make_symbol(const char* const s)
+inline Cell* make_symbol(const std::string_view s)
 {
-  return new SymbolCell(s);
+  return intern(s);
 }
 
 /**
- * \brief Make a conspair cell.
+ * \brief Make a conspair cell, the canonical one while hash-consing.
  * \param my_car The initial car pointer to be stored in the new cell.
  * \param my_cdr The initial cdr pointer to be stored in the new cell.
  */
 inline Cell* cons(Cell* const my_car, Cell* const my_cdr)
 {
+  if (hash_consing) {
+    return hash_cons(my_car, my_cdr);
+  }
   return new ConsCell(my_car, my_cdr);
 }
 
+/**
+ * \brief Check if c points to a cell of type t, by its tag.
+ * \return True iff c is a cell, not an immediate, of type t.
+ */
+inline bool has_type(const Cell* const c, const CellType t)
+{
+  return !immediatep(c) && c->type() == t;
+}
+
 /**
  * \brief Check if c points to an empty list, i.e., is a null pointer.
  * \return True iff c points to an empty list, i.e., is a null pointer.
  */
 inline bool nullp(Cell* const c)
 {
-  return c->is_nil();
+  return has_type(c, CELL_NIL);
 }
 
 /**
@@ -80,7 +358,7 @@ inline bool nullp(Cell* const c)
  */
 inline bool listp(Cell* const c)
 {
-  return nullp(c) || c->is_cons();
+  return has_type(c, CELL_NIL) || has_type(c, CELL_CONS);
 }
 
 /**
@@ -89,7 +367,7 @@ inline bool listp(Cell* const c)
  */
 inline bool intp(Cell* const c)
 {
-  return !nullp(c) && c->is_int();
+  return fixnump(c) || has_type(c, CELL_INT);
 }
 
 /**
@@ -98,7 +376,25 @@ inline bool intp(Cell* const c)
  */
 inline bool doublep(Cell* const c)
 {
-  return !nullp(c) && c->is_double();
+  return flonump(c) || has_type(c, CELL_DOUBLE);
+}
+
+/**
+ * \brief Check if c points to a bignum cell.
+ * \return True iff c points to a bignum cell.
+ */
+inline bool bigintp(Cell* const c)
+{
+  return has_type(c, CELL_BIGINT);
+}
+
+/**
+ * \brief Check if c points to a vector cell.
+ * \return True iff c points to a vector cell.
+ */
+inline bool vectorp(Cell* const c)
+{
+  return has_type(c, CELL_VECTOR);
 }
 
 /**
@@ -107,16 +403,44 @@ inline bool doublep(Cell* const c)
  */
 inline bool symbolp(Cell* const c)
 {
-  return !nullp(c) && c->is_symbol();
+  return has_type(c, CELL_SYMBOL);
+}
+
+/**
+ * \brief Run a member function on the cell c stands for.  An immediate
+ * is boxed into a temporary cell on the stack first, so it behaves,
+ * and reports errors, exactly like the heap cell it replaces.
+ * \param c The cell or immediate.
+ * \param f The operation.
+ * \return The result of f.
+ */
+template <typename F>
+inline auto with_cell(const Cell* const c, F f) -> decltype(f(c))
+{
+  if (fixnump(c)) {
+    IntCell boxed(fixnum_value(c));
+    return f(&boxed);
+  }
+  if (flonump(c)) {
+    DoubleCell boxed(flonum_value(c));
+    return f(&boxed);
+  }
+  return f(c);
 }
 
 /**
  * \brief Accessor (error if c is not an int cell).
  * \return The value in the int cell pointed to by c.
  */
-inline int get_int(Cell* const c)
+inline int64_t get_int(Cell* const c)
 {
-  return c->get_int();
+  if (fixnump(c)) {
+    return fixnum_value(c);
+  }
+  if (has_type(c, CELL_INT)) {
+    return static_cast<const IntCell*>(c)->value();
+  }
+  return with_cell(c, [](const Cell* x) { return x->get_int(); });
 }
 
 /**
@@ -125,7 +449,13 @@ inline int get_int(Cell* const c)
  */
 inline double get_double(Cell* const c)
 {
-  return c->get_double();
+  if (flonump(c)) {
+    return flonum_value(c);
+  }
+  if (has_type(c, CELL_DOUBLE)) {
+    return static_cast<const DoubleCell*>(c)->value();
+  }
+  return with_cell(c, [](const Cell* x) { return x->get_double(); });
 }
 
 /**
@@ -135,7 +465,7 @@ inline double get_double(Cell* const c)
  */
 inline std::string get_symbol(Cell* const c)
 {
-  return c->get_symbol();
+  return with_cell(c, [](const Cell* x) { return x->get_symbol(); });
 }
 
 /**
@@ -144,7 +474,10 @@ inline std::string get_symbol(Cell* const c)
  */
 inline Cell* car(Cell* const c)
 {
-  return c->get_car();
+  if (has_type(c, CELL_CONS)) {
+    return static_cast<const ConsCell*>(c)->head();
+  }
+  return with_cell(c, [](const Cell* x) { return x->get_car(); });
 }
 
 /**
@@ -153,7 +486,325 @@ inline Cell* car(Cell* const c)
  */
 inline Cell* cdr(Cell* const c)
 {
-  return c->get_cdr();
+  if (has_type(c, CELL_CONS)) {
+    return static_cast<const ConsCell*>(c)->tail();
+  }
+  return with_cell(c, [](const Cell* x) { return x->get_cdr(); });
+}
+
+/**
+ * \brief The write barrier: remember c for the next evacuation if it
+ * now points to v in the young generation, since the evacuation only
+ * finds young cells through the roots and the remembered cells.  While
+ * marking, also shade v, so that a black c never points to a white v.
+ * \param c The cell written to.
+ * \param v The value written.
+ */
+inline void write_barrier(Cell* const c, Cell* const v)
+{
+  if (immediatep(v)) {
+    return;
+  }
+  if (SLAB_ARENA == slab_of(v)->kind) {
+    gc_remember(c);
+  } else if (gc_marking) {
+    gc_shade(v);
+  }
+}
+
+/**
+ * \brief Most elements make-vector builds: 2 GB of element pointers.
+ * Longer vectors are refused before any memory is taken.
+ */
+const int64_t MAX_VECTOR_LENGTH = int64_t(1) << 28;
+
+/**
+ * \brief Make a vector cell holding count elements.  The element array
+ * is freed by the destructor, which arena cells never run, so vectors
+ * always go to the heap.  A single remembered entry covers every young
+ * element.
+ * \param elems The elements.
+ * \param count The number of elements.
+ */
+inline Cell* make_vector(Cell* const* const elems, const size_t count)
+{
+  Cell* v;
+  {
+    HeapScope heap;
+    v = new VectorCell(elems, count);
+  }
+  bool young = false;
+  for (size_t i = 0; i < count; ++i) {
+    if (immediatep(elems[i])) {
+      continue;
+    }
+    if (SLAB_ARENA == slab_of(elems[i])->kind) {
+      young = true;
+    } else if (gc_marking) {
+      gc_shade(elems[i]);
+    }
+  }
+  if (young) {
+    gc_remember(v);
+  }
+  return v;
+}
+
+/**
+ * \brief Make a vector cell of count copies of fill.
+ * \param count The number of elements.
+ * \param fill The value of every element.
+ */
+inline Cell* make_vector(const size_t count, Cell* const fill)
+{
+  Cell* v;
+  {
+    HeapScope heap;
+    v = new VectorCell(count, fill);
+  }
+  if (0 != count) {
+    write_barrier(v, fill);
+  }
+  return v;
+}
+
+/**
+ * \brief Accessor (error if c is not a vector cell).
+ * \return The number of elements of the vector c.
+ */
+inline size_t vector_length(Cell* const c)
+{
+  if (!vectorp(c)) {
+    throw std::runtime_error("ERROR: Vector length of non-vector cell.\n");
+  }
+  return static_cast<const VectorCell*>(c)->size();
+}
+
+/**
+ * \brief Accessor (error if c is not a vector cell or i is out of
+ * range).
+ * \param c The vector cell.
+ * \param i The index.
+ * \return The element at index i.
+ */
+inline Cell* vector_ref(Cell* const c, const size_t i)
+{
+  if (i >= vector_length(c)) {
+    throw std::runtime_error("ERROR: Vector index out of range.\n");
+  }
+  return static_cast<const VectorCell*>(c)->item(i);
+}
+
+/**
+ * \brief Replace an element of a vector cell (error if c is not a
+ * vector cell or i is out of range), recording the cell for the
+ * collector when it now points into the young generation.
+ * \param c The vector cell.
+ * \param i The index.
+ * \param v The new element.
+ */
+inline void vector_set(Cell* const c, const size_t i, Cell* const v)
+{
+  if (i >= vector_length(c)) {
+    throw std::runtime_error("ERROR: Vector index out of range.\n");
+  }
+  static_cast<VectorCell*>(c)->set_item(i, v);
+  write_barrier(c, v);
+}
+
+/**
+ * \brief Replace the car of a cons cell (error if c is not a cons
+ * cell), recording the cell for the collector when it now points into
+ * the young generation.
+ * \param c The cons cell.
+ * \param v The new car.
+ */
+inline void set_car(Cell* const c, Cell* const v)
+{
+  if (!has_type(c, CELL_CONS)) {
+    throw std::runtime_error("ERROR: Set car for non-cons cell.\n");
+  }
+  static_cast<ConsCell*>(c)->set_head(v);
+  write_barrier(c, v);
+}
+
+/**
+ * \brief Replace the cdr of a cons cell (error if c is not a cons
+ * cell), recording the cell for the collector when it now points into
+ * the young generation.
+ * \param c The cons cell.
+ * \param v The new cdr.
+ */
+inline void set_cdr(Cell* const c, Cell* const v)
+{
+  if (!has_type(c, CELL_CONS)) {
+    throw std::runtime_error("ERROR: Set cdr for non-cons cell.\n");
+  }
+  static_cast<ConsCell*>(c)->set_tail(v);
+  write_barrier(c, v);
+}
+
+/**
+ * \brief Read c as an int without boxing or errors, for the exact
+ * integer paths of the arithmetic.
+ * \param c The cell or immediate.
+ * \param v Set to the value of c if it is an int.
+ * \return True iff c is an int.
+ */
+inline bool int_value(Cell* const c, int64_t& v)
+{
+  if (fixnump(c)) {
+    v = fixnum_value(c);
+    return true;
+  }
+  if (has_type(c, CELL_INT)) {
+    v = static_cast<const IntCell*>(c)->value();
+    return true;
+  }
+  return false;
+}
+
+/**
+ * \brief Read c as an exact integer of any size, for the bignum paths
+ * of the arithmetic.
+ * \param c The cell or immediate.
+ * \param v Set to the value of c if it is an int or a bignum.
+ * \return True iff c is an int or a bignum.
+ */
+inline bool integer_value(Cell* const c, BigInt& v)
+{
+  int64_t i;
+  if (int_value(c, i)) {
+    v = BigInt(i);
+    return true;
+  }
+  if (bigintp(c)) {
+    const BigIntCell* b = static_cast<const BigIntCell*>(c);
+    v = BigInt(b->is_negative(), b->limbs(), b->size());
+    return true;
+  }
+  return false;
+}
+
+/**
+ * \brief Add the number in c to n (error if c is not a number).
+ * \param c The number cell.
+ * \param is_int Cleared if c holds a double.
+ * \param n The running sum.
+ */
+inline void plus_c(Cell* const c, bool& is_int, double& n)
+{
+  if (fixnump(c)) {
+    n += fixnum_value(c);
+  } else if (flonump(c)) {
+    is_int = false;
+    n += flonum_value(c);
+  } else if (has_type(c, CELL_INT)) {
+    n += static_cast<const IntCell*>(c)->value();
+  } else if (has_type(c, CELL_DOUBLE)) {
+    is_int = false;
+    n += static_cast<const DoubleCell*>(c)->value();
+  } else {
+    c->plus_c(is_int, n);
+  }
+}
+
+/**
+ * \brief Multiply n by the number in c (error if c is not a number).
+ * \param c The number cell.
+ * \param is_int Cleared if c holds a double.
+ * \param n The running product.
+ */
+inline void multi_c(Cell* const c, bool& is_int, double& n)
+{
+  if (fixnump(c)) {
+    n *= fixnum_value(c);
+  } else if (flonump(c)) {
+    is_int = false;
+    n *= flonum_value(c);
+  } else if (has_type(c, CELL_INT)) {
+    n *= static_cast<const IntCell*>(c)->value();
+  } else if (has_type(c, CELL_DOUBLE)) {
+    is_int = false;
+    n *= static_cast<const DoubleCell*>(c)->value();
+  } else {
+    c->multi_c(is_int, n);
+  }
+}
+
+/**
+ * \brief Round the number in c up (error if c is not a number).
+ * \return The ceilinged number.
+ */
+inline Cell* ceiling_c(Cell* const c)
+{
+  if (fixnump(c)) {
+    return c;
+  }
+  return with_cell(c, [](const Cell* x) { return x->ceiling_c(); });
+}
+
+/**
+ * \brief Round the number in c down (error if c is not a number).
+ * \return The floored number.
+ */
+inline Cell* floor_c(Cell* const c)
+{
+  if (fixnump(c)) {
+    return c;
+  }
+  return with_cell(c, [](const Cell* x) { return x->floor_c(); });
+}
+
+/**
+ * \brief Compare the number in c with n (error if c is not a number).
+ * \param c The number cell.
+ * \param b Set if n is smaller than the number in c.
+ * \param n The previous number, replaced by the number in c.
+ */
+inline void less_c(Cell* const c, bool& b, double& n)
+{
+  if (intp(c) || doublep(c)) {
+    double m = intp(c) ? get_int(c) : get_double(c);
+    b = b || n < m;
+    n = m;
+  } else {
+    c->less_c(b, n);
+  }
+}
+
+/**
+ * \brief The not function.
+ * \return 1 if c contains 0 or 0.0.
+ */
+inline int not_c(Cell* const c)
+{
+  return with_cell(c, [](const Cell* x) { return x->not_c(); });
+}
+
+/**
+ * \brief Make a copy of the cell c stands for.  Immediates and the
+ * empty list are values, and are returned as they are.  Evaluation
+ * shares cells instead, so a copy is only needed before mutating
+ * structure that may be shared.
+ * \return A copy of c.
+ */
+inline Cell* clone(Cell* const c)
+{
+  if (immediatep(c) || c == nil || c->type() == CELL_SYMBOL) {
+    return c;
+  }
+  return c->clone();
+}
+
+/**
+ * \brief Print the subtree rooted at c, in s-expression notation.
+ * \param os The output stream to print to.
+ * \param c The root cell of the subtree to be printed.
+ */
+inline void print_cell(std::ostream& os, const Cell* const c)
+{
+  with_cell(c, [&](const Cell* x) { x->print(os); });
 }
 
 /**
@@ -8,6 +8,8 @@
 
 #include "eval.hpp"
 #include<cmath>
+#include <new>
+#include <vector>
 
 /**
  * \brief Evaluate plus cell.
@@ -17,22 +19,62 @@
  */
 Cell* eval_plus(Cell* const c, bool is_minus=false)
 {
-  if (is_minus && (nullp(c) || nullp(cdr(c)))) {
-    cerr << "ERROR: At least two parameters are needed for minus operator.\n";
-    exit(1);
-  }
-  bool is_int = true;
-  double d = 0;
-  Cell* cur = c;
   // Case minus would be a - b - c - ... = - (-a + b + c + ...)
-  if (is_minus) {
-    eval(car(cur))->plus_c(is_int, d);
+  // Sum exactly in int64_t while the arguments are ints.
+  int64_t sum = 0;
+  Cell* cur = c;
+  Cell* x = NULL;
+  bool first = is_minus;
+  while (first || !nullp(cur)) {
+    x = eval(car(cur));
+    int64_t v;
+    if (!int_value(x, v) || (first ? __builtin_sub_overflow(sum, v, &v)
+                                   : __builtin_add_overflow(sum, v, &v))) {
+      break;
+    }
+    sum = v;
+    x = NULL;
+    first = false;
     cur = cdr(cur);
-    d = -d;
   }
-  while (!nullp(cur)) {
-    eval(car(cur))->plus_c(is_int, d);
+  if (NULL == x) {
+    int64_t v;
+    if (!is_minus) {
+      return make_int(sum);
+    } else if (!__builtin_sub_overflow(0, sum, &v)) {
+      return make_int(v);
+    }
+    BigInt big(sum);
+    big_negate(big);
+    return make_integer(big);
+  }
+  // x is a bignum, or the sum overflowed: go on exactly in bignums
+  BigInt big(sum);
+  BigInt v;
+  while (integer_value(x, v)) {
+    if (first) {
+      big_negate(v);
+      first = false;
+    }
+    big_add(big, v);
     cur = cdr(cur);
+    if (nullp(cur)) {
+      if (is_minus) {
+        big_negate(big);
+      }
+      return make_integer(big);
+    }
+    x = eval(car(cur));
+  }
+  // x is a double: go on in double
+  bool is_int = true;
+  double d = big_to_double(big);
+  plus_c(x, is_int, d);
+  if (first) {
+    d = -d;
+  }
+  for (cur = cdr(cur); !nullp(cur); cur = cdr(cur)) {
+    plus_c(eval(car(cur)), is_int, d);
   }
   if (is_minus) {
     d = -d;
@@ -58,22 +100,71 @@ Cell* eval_minus(Cell* const c)
  */
 Cell* eval_multi(Cell* const c, bool is_divide=false)
 {
-  if (is_divide && (nullp(c) || nullp(cdr(c)))) {
-    cerr << "ERROR: At least two parameters are needed for minus operator.\n";
-    exit(1);
-  }
-  bool is_int = true;
-  double d = 1;
-  double n = 1;
+  // Multiply exactly in int64_t while the arguments are ints.
+  int64_t dividend = 1;
+  int64_t product = 1;
   Cell* cur = c;
-  if (is_divide) {
-    eval(car(cur))->multi_c(is_int, n);
+  Cell* x = NULL;
+  bool first = is_divide;
+  while ((first || !nullp(cur)) && 0 != product) {
+    x = eval(car(cur));
+    int64_t v;
+    if (!int_value(x, v) || (!first && __builtin_mul_overflow(product, v, &v))) {
+      break;
+    }
+    if (first) {
+      dividend = v;
+    } else {
+      product = v;
+    }
+    x = NULL;
+    first = false;
     cur = cdr(cur);
   }
-  while (!nullp(cur)) {
-    eval(car(cur))->multi_c(is_int, d);
-    if (d == 0) break;
+  if (NULL == x) {
+    if (!is_divide) {
+      return make_int(product);
+    }
+    if (0 == product) {
+      cerr << "ERROR: The divisor cannot be zero.\n";
+      exit(1);
+    }
+    if (INT64_MIN != dividend || -1 != product) {
+      return make_int(dividend / product);
+    }
+    return make_integer(big_div(BigInt(dividend), BigInt(product)));
+  }
+  // x is a bignum, or the product overflowed: go on exactly in bignums
+  BigInt big_dividend(dividend);
+  BigInt big(product);
+  BigInt v;
+  while (integer_value(x, v)) {
+    if (first) {
+      big_dividend = v;
+      first = false;
+    } else {
+      big_mul(big, v);
+    }
     cur = cdr(cur);
+    if (nullp(cur) || big.mag.empty()) {
+      if (!is_divide) {
+        return make_integer(big);
+      }
+      if (big.mag.empty()) {
+        cerr << "ERROR: The divisor cannot be zero.\n";
+        exit(1);
+      }
+      return make_integer(big_div(big_dividend, big));
+    }
+    x = eval(car(cur));
+  }
+  // x is a double: go on in double
+  bool is_int = true;
+  double d = big_to_double(big);
+  double n = big_to_double(big_dividend);
+  multi_c(x, is_int, first ? n : d);
+  for (cur = cdr(cur); !nullp(cur) && d != 0; cur = cdr(cur)) {
+    multi_c(eval(car(cur)), is_int, d);
   }
   if (is_divide) {
     if (d == 0) {
@@ -102,11 +193,7 @@ Cell* eval_divide(Cell* const c)
  */
 Cell* eval_ceiling(Cell* const c)
 {
-  if (nullp(c) || !nullp(cdr(c))) {
-    cerr << "ERROR: Exactly one parameter is needed for ceiling.\n";
-    exit(1);
-  }
-  return eval(car(c))->ceiling_c();
+  return ceiling_c(eval(car(c)));
 }
 
 /**
@@ -116,11 +203,7 @@ Cell* eval_ceiling(Cell* const c)
  */
 Cell* eval_floor(Cell* const c)
 {
-  if (nullp(c) || !nullp(cdr(c))) {
-    cerr << "ERROR: Exactly one parameter is needed for floor.\n";
-    exit(1);
-  }
-  return eval(car(c))->floor_c();
+  return floor_c(eval(car(c)));
 }
 
 /**
@@ -165,17 +248,49 @@ Cell* eval_if(Cell* const c)
 /**
  * \brief Evalute quote.
  * \param c Quote cell.
- * \return The car of c's cdr.
+ * \return The car of c's cdr, shared with the parse tree.
 */
 Cell* eval_quote(Cell* const c)
 {
-  if (nullp(c) || !nullp(cdr(c))) {
-    cerr << "ERROR: Exactly one parameter is needed for quote.\n";
-    exit(1);
-  }
   return car(c);
 }
 
+/**
+ * \brief Evaluate gc-stats.
+ * \param c The empty argument list.
+ * \return An association list of the collector counters, with the
+ * pause histogram keyed by the upper bound of each bucket in
+ * microseconds.
+ */
+Cell* eval_gc_stats(Cell* const c)
+{
+  GcStats s = gc_stats();
+  Cell* histogram = nil;
+  for (size_t i = GC_PAUSE_BUCKETS; i-- > 0; ) {
+    Cell* bound = i + 1 < GC_PAUSE_BUCKETS ? make_int(GC_PAUSE_BOUNDS_US[i]) : make_symbol("inf");
+    histogram = cons(cons(bound, cons(make_int(s.pauses[i]), nil)), histogram);
+  }
+  struct {
+    const char* name;
+    Cell* value;
+  } fields[] = {
+    { "collections", make_int(s.collections) },
+    { "slices", make_int(s.slices) },
+    { "evacuations", make_int(s.evacuations) },
+    { "promoted", make_int(s.promoted) },
+    { "freed", make_int(s.freed) },
+    { "live-bytes", make_int(s.live_bytes) },
+    { "heap-bytes", make_int(s.heap_bytes) },
+    { "max-pause-ms", make_double(s.max_pause_ms) },
+    { "pause-histogram-us", histogram },
+  };
+  Cell* result = nil;
+  for (size_t i = sizeof(fields) / sizeof(fields[0]); i-- > 0; ) {
+    result = cons(cons(make_symbol(fields[i].name), cons(fields[i].value, nil)), result);
+  }
+  return result;
+}
+
 /**
  * \brief Evalute cons.
  * \param c cons cell.
@@ -183,10 +298,6 @@ Cell* eval_quote(Cell* const c)
 */
 Cell* eval_cons(Cell* const c)
 {
-  if (nullp(c) || nullp(cdr(c)) || !nullp(cdr(cdr(c)))) {
-    cerr << "ERROR: Exactly two parameter is needed for cons.\n";
-    exit(1);
-  }
   Cell* second = eval(car(cdr(c)));
   if (!listp(second)) {
     cerr << "ERROR: Second parameter should be list after eval for cons.\n";
@@ -202,10 +313,6 @@ Cell* eval_cons(Cell* const c)
 */
 Cell* eval_car(Cell* const c)
 {
-  if (nullp(c) || !nullp(cdr(c))) {
-    cerr << "ERROR: Exactly one parameter is needed for car.\n";
-    exit(1);
-  }
   Cell* first = eval(car(c));
   if (!listp(first)) {
     cerr << "ERROR: first parameter should be list after eval for car.\n";
@@ -221,10 +328,6 @@ Cell* eval_car(Cell* const c)
 */
 Cell* eval_cdr(Cell* const c)
 {
-  if (nullp(c) || !nullp(cdr(c))) {
-    cerr << "ERROR: Exactly one parameter is needed for cdr.\n";
-    exit(1);
-  }
   Cell* first = eval(car(c));
   if (!listp(first)) {
     cerr << "ERROR: first parameter should be list after eval for cdr.\n";
@@ -240,15 +343,253 @@ Cell* eval_cdr(Cell* const c)
 */
 Cell* eval_nullp(Cell* const c)
 {
-  if (nullp(c) || !nullp(cdr(c))) {
-    cerr << "ERROR: Exactly one parameter is needed for cdr.\n";
+  return nullp(eval(car(c))) ? make_int(1) : make_int(0);
+}
+
+/**
+ * \brief Evaluate the vector argument of a vector primitive.
+ * \param c The argument.
+ * \param name The primitive, for the error message.
+ * \return The vector cell.
+ */
+static Cell* eval_vector_arg(Cell* const c, const char* name)
+{
+  Cell* v = eval(c);
+  if (!vectorp(v)) {
+    cerr << "ERROR: First parameter should be vector after eval for " << name << ".\n";
     exit(1);
   }
-  return nullp(eval(car(c))) ? make_int(1) : make_int(0);
+  return v;
 }
 
 /**
- * \brief Evaluate cell c.
+ * \brief Evaluate the index argument of a vector primitive.
+ * \param c The argument.
+ * \param v The vector cell.
+ * \param name The primitive, for the error message.
+ * \return The index, checked against the length of v.
+ */
+static size_t eval_index_arg(Cell* const c, Cell* const v, const char* name)
+{
+  Cell* k = eval(c);
+  if (!intp(k) || get_int(k) < 0 || static_cast<uint64_t>(get_int(k)) >= vector_length(v)) {
+    cerr << "ERROR: Index out of range for " << name << ".\n";
+    exit(1);
+  }
+  return get_int(k);
+}
+
+/**
+ * \brief Evaluate make-vector.
+ * \param c The length, and optionally the initial value of every
+ * element, 0 by default.
+ * \return The new vector cell.
+ */
+Cell* eval_make_vector(Cell* const c)
+{
+  Cell* k = eval(car(c));
+  if (!intp(k) || get_int(k) < 0) {
+    cerr << "ERROR: First parameter should be a non-negative int for make-vector.\n";
+    exit(1);
+  }
+  if (get_int(k) > MAX_VECTOR_LENGTH) {
+    cerr << "ERROR: Vector length out of range for make-vector.\n";
+    exit(1);
+  }
+  Cell* fill = nullp(cdr(c)) ? make_int(0) : eval(car(cdr(c)));
+  try {
+    return make_vector(get_int(k), fill);
+  } catch (bad_alloc&) {
+    cerr << "ERROR: Out of memory for make-vector.\n";
+    exit(1);
+  }
+}
+
+/**
+ * \brief Evaluate vector-ref.
+ * \param c The vector and the index.
+ * \return The element at the index.
+ */
+Cell* eval_vector_ref(Cell* const c)
+{
+  Cell* v = eval_vector_arg(car(c), "vector-ref");
+  return vector_ref(v, eval_index_arg(car(cdr(c)), v, "vector-ref"));
+}
+
+/**
+ * \brief Evaluate vector-set!.
+ * \param c The vector, the index and the new element.
+ * \return The vector itself, so that updates can be chained without
+ * variables.
+ */
+Cell* eval_vector_set(Cell* const c)
+{
+  Cell* v = eval_vector_arg(car(c), "vector-set!");
+  size_t i = eval_index_arg(car(cdr(c)), v, "vector-set!");
+  vector_set(v, i, eval(car(cdr(cdr(c)))));
+  return v;
+}
+
+/**
+ * \brief Evaluate vector-length.
+ * \param c The vector.
+ * \return The number of elements.
+ */
+Cell* eval_vector_length(Cell* const c)
+{
+  return make_int(vector_length(eval_vector_arg(car(c), "vector-length")));
+}
+
+/**
+ * \brief Evaluate list->vector.
+ * \param c The list.
+ * \return A new vector cell with the elements of the list.
+ */
+Cell* eval_list_to_vector(Cell* const c)
+{
+  Cell* list = eval(car(c));
+  if (!listp(list)) {
+    cerr << "ERROR: First parameter should be list after eval for list->vector.\n";
+    exit(1);
+  }
+  vector<Cell*> elems;
+  for (; !nullp(list); list = cdr(list)) {
+    elems.push_back(car(list));
+  }
+  return make_vector(elems.data(), elems.size());
+}
+
+/**
+ * \brief The builtins, registered in the primitive table on first use.
+ * The arity errors are checked by eval before the handler runs.
+ */
+static const struct {
+  const char* name;
+  Primitive primitive;
+} builtins[] = {
+  { "+", { [](Cell* const c) { return eval_plus(c); }, 0, VARIADIC, NULL } },
+  { "-", { eval_minus, 2, VARIADIC,
+           "ERROR: At least two parameters are needed for minus operator.\n" } },
+  { "*", { [](Cell* const c) { return eval_multi(c); }, 0, VARIADIC, NULL } },
+  { "/", { eval_divide, 2, VARIADIC,
+           "ERROR: At least two parameters are needed for minus operator.\n" } },
+  { "ceiling", { eval_ceiling, 1, 1,
+                 "ERROR: Exactly one parameter is needed for ceiling.\n" } },
+  { "floor", { eval_floor, 1, 1,
+               "ERROR: Exactly one parameter is needed for floor.\n" } },
+  { "if", { eval_if, 0, VARIADIC, NULL } },
+  { "quote", { eval_quote, 1, 1,
+               "ERROR: Exactly one parameter is needed for quote.\n" } },
+  { "cons", { eval_cons, 2, 2,
+              "ERROR: Exactly two parameter is needed for cons.\n" } },
+  { "car", { eval_car, 1, 1,
+             "ERROR: Exactly one parameter is needed for car.\n" } },
+  { "cdr", { eval_cdr, 1, 1,
+             "ERROR: Exactly one parameter is needed for cdr.\n" } },
+  { "nullp", { eval_nullp, 1, 1,
+               "ERROR: Exactly one parameter is needed for cdr.\n" } },
+  { "make-vector", { eval_make_vector, 1, 2,
+                     "ERROR: One or two parameters are needed for make-vector.\n" } },
+  { "vector-ref", { eval_vector_ref, 2, 2,
+                    "ERROR: Exactly two parameters are needed for vector-ref.\n" } },
+  { "vector-set!", { eval_vector_set, 3, 3,
+                     "ERROR: Exactly three parameters are needed for vector-set!.\n" } },
+  { "vector-length", { eval_vector_length, 1, 1,
+                       "ERROR: Exactly one parameter is needed for vector-length.\n" } },
+  { "list->vector", { eval_list_to_vector, 1, 1,
+                      "ERROR: Exactly one parameter is needed for list->vector.\n" } },
+  { "gc-stats", { eval_gc_stats, 0, 0,
+                  "ERROR: No parameter is needed for gc-stats.\n" } },
+};
+
+/**
+ * \brief The primitive table.  Each keyword symbol records its index
+ * in this table, so lookup is a single array access.
+ */
+static vector<Primitive> primitives;
+
+/**
+ * \brief Add a primitive to the table, or replace the one registered
+ * under the same name.
+ */
+static void add_primitive(const string_view name, const Primitive& primitive)
+{
+  SymbolCell* symbol = static_cast<SymbolCell*>(make_symbol(name));
+  if (symbol->primitive_slot() < 0) {
+    symbol->set_primitive_slot(primitives.size());
+    primitives.push_back(primitive);
+  } else {
+    primitives[symbol->primitive_slot()] = primitive;
+  }
+}
+
+/**
+ * \brief Register the builtins, exactly once, before the first
+ * primitive is defined or looked up, so that user primitives come
+ * after them and may replace them.
+ */
+static void register_builtins()
+{
+  static const bool registered = []() {
+    for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); ++i) {
+      add_primitive(builtins[i].name, builtins[i].primitive);
+    }
+    return true;
+  }();
+  (void) registered;
+}
+
+/**
+ * \brief Register a primitive under a name, replacing any earlier one,
+ * builtins included.  Primitives are registered before any evaluation,
+ * not from threads.
+ * \param name The keyword.
+ * \param primitive The handler and its arity.
+ */
+void define_primitive(const string_view name, const Primitive& primitive)
+{
+  register_builtins();
+  add_primitive(name, primitive);
+}
+
+/**
+ * \brief Look up the primitive registered under a symbol.
+ * \param symbol The interned keyword.
+ * \return The primitive, or NULL if none is registered.
+ */
+const Primitive* find_primitive(Cell* const symbol)
+{
+  register_builtins();
+  int slot = static_cast<const SymbolCell*>(symbol)->primitive_slot();
+  return slot < 0 ? NULL : &primitives[slot];
+}
+
+/**
+ * \brief Check the number of arguments against a primitive's arity,
+ * counting no further than needed.
+ * \param p The primitive.
+ * \param args The argument list.
+ */
+static void check_arity(const Primitive& p, Cell* const args)
+{
+  int limit = VARIADIC == p.max_args ? p.min_args : p.max_args + 1;
+  int n = 0;
+  for (Cell* cur = args; n < limit && !nullp(cur); cur = cdr(cur)) {
+    ++n;
+  }
+  if (n < p.min_args || (VARIADIC != p.max_args && n > p.max_args)) {
+    cerr << p.arity_error;
+    exit(1);
+  }
+}
+
+/**
+ * \brief Evaluate cell c.  The result may share cells with c, so
+ * neither may be mutated afterwards.  Vectors are the exception:
+ * vector-set! changes one in place, so every holder of it sees the
+ * change.  That cannot reach a parse tree, or a tree shared through
+ * hash-consing or the parse cache, because vectors have no literal
+ * syntax; they only come from evaluation.
  * \param c The evaluated cell.
  * \return A constant cell which contains int/double.
  */
@@ -256,37 +597,21 @@ Cell* eval(Cell* const c)
 {
   Cell* cell;
   if (listp(c) && !nullp(c)) {
-    string s = get_symbol(eval(car(c)));
-    if (s == "+") {
-      cell = eval_plus(cdr(c));
-    } else if (s == "-") {
-      cell = eval_minus(cdr(c));
-    } else if (s == "*") {
-      cell = eval_multi(cdr(c));
-    } else if (s == "/") {
-      cell = eval_divide(cdr(c));
-    } else if (s == "ceiling") {
-      cell = eval_ceiling(cdr(c));
-    } else if (s == "floor") {
-      cell = eval_floor(cdr(c));
-    } else if (s == "if") {
-      cell = eval_if(cdr(c));
-    } else if (s == "quote") {
-      cell = eval_quote(cdr(c));
-    } else if (s == "cons") {
-      cell = eval_cons(cdr(c));
-    } else if (s == "car") {
-      cell = eval_car(cdr(c));
-    } else if (s == "cdr") {
-      cell = eval_cdr(cdr(c));
-    } else if (s == "nullp") {
-      cell = eval_nullp(cdr(c));
-    } else {
-      cerr << "ERROR: key word '" << s << "' not supported yet.\n";
+    // a keyword is looked up directly; anything else is evaluated first
+    Cell* op = symbolp(car(c)) ? car(c) : eval(car(c));
+    if (!symbolp(op)) {
+      get_symbol(op); // reports the usual non-symbol error
+    }
+    const Primitive* p = find_primitive(op);
+    if (NULL == p) {
+      cerr << "ERROR: key word '" << get_symbol(op) << "' not supported yet.\n";
       exit(1);
     }
+    check_arity(*p, cdr(c));
+    cell = p->fn(cdr(c));
   } else {
-    cell = c->clone();
+    // atoms are immutable, so they are shared rather than copied
+    cell = c;
   } 
   return cell;
 }
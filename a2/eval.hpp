@@ -8,9 +8,45 @@
 #define EVAL_HPP
 
 #include "cons.hpp"
+#include <string_view>
 
 using namespace std;
 
+/**
+ * \brief A builtin handler, called with the unevaluated argument list.
+ */
+typedef Cell* (*PrimitiveFn)(Cell* const args);
+
+/**
+ * \brief Arity bound meaning any number of arguments.
+ */
+const int VARIADIC = -1;
+
+/**
+ * \brief A builtin and the number of arguments it accepts.
+ */
+struct Primitive {
+  PrimitiveFn fn;          ///< The handler.
+  int min_args;            ///< The fewest arguments accepted.
+  int max_args;            ///< The most arguments accepted, or VARIADIC.
+  const char* arity_error; ///< Printed when the count is out of range.
+};
+
+/**
+ * \brief Register a primitive under a name, replacing any earlier one,
+ * builtins included.  Call it before any evaluation.
+ * \param name The keyword.
+ * \param primitive The handler and its arity.
+ */
+void define_primitive(const string_view name, const Primitive& primitive);
+
+/**
+ * \brief Look up the primitive registered under a symbol.
+ * \param symbol The interned keyword.
+ * \return The primitive, or NULL if none is registered.
+ */
+const Primitive* find_primitive(Cell* const symbol);
+
 /**
  * \brief Evaluate the expression tree whose root is pointed to by c
  * (error if c does not hold a well-formed expression).
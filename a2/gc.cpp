@@ -0,0 +1,527 @@
+/**
+ * \file gc.cpp
+ *
+ * Implementation of the generational garbage collector.
+ */
+
+#include "gc.hpp"
+#include "cons.hpp"
+#include "hashcons.hpp"
+#include "pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace std;
+
+bool gc_marking = false;
+
+namespace {
+
+/**
+ * \brief The registered roots and the collector state.  Never
+ * destroyed, so roots may be unregistered during exit.
+ */
+struct Collector {
+  list<Cell**> slots;
+  list<RootScanner> scanners;
+  GcStats stats = {};
+  size_t allocated_at_last = 0;
+  double budget_ms = 0.0;
+  bool sweeping = false;
+  size_t frees_at_sweep = 0;
+  vector<Cell*> stack;
+  mutex shade_lock;
+  vector<Cell**> roots;
+  vector<Cell*> remembered;
+};
+
+Collector& collector()
+{
+  static Collector* c = new Collector;
+  return *c;
+}
+
+/**
+ * \brief Run the destructor of a dead cell, after dropping it from the
+ * weak hash-consing table.
+ */
+void finalize(void* p)
+{
+  Cell* cell = static_cast<Cell*>(p);
+  if (cell->is_canonical()) {
+    hash_forget(cell);
+  }
+  cell->~Cell();
+}
+
+/**
+ * \brief Check if a cell lives in an arena, i.e. in the young
+ * generation of some scope.
+ */
+inline bool in_arena(const Cell* c)
+{
+  return !immediatep(c) && SLAB_ARENA == slab_of(c)->kind;
+}
+
+/**
+ * \brief Check if a cell has a field pointing into an arena.
+ */
+bool points_into_arena(const Cell* c)
+{
+  if (CELL_VECTOR == c->type()) {
+    const VectorCell* v = static_cast<const VectorCell*>(c);
+    for (size_t i = 0; i < v->size(); ++i) {
+      if (in_arena(v->item(i))) {
+        return true;
+      }
+    }
+    return false;
+  }
+  if (CELL_CONS != c->type()) {
+    return false;
+  }
+  const ConsCell* cc = static_cast<const ConsCell*>(c);
+  return in_arena(cc->head()) || in_arena(cc->tail());
+}
+
+/**
+ * \brief Record a pause in the longest pause and the histogram.
+ */
+void record_pause(GcStats& stats, chrono::steady_clock::time_point start)
+{
+  chrono::duration<double, micro> pause = chrono::steady_clock::now() - start;
+  stats.max_pause_ms = max(stats.max_pause_ms, pause.count() / 1000);
+  size_t bucket = 0;
+  while (bucket + 1 < GC_PAUSE_BUCKETS && pause.count() >= GC_PAUSE_BOUNDS_US[bucket]) {
+    ++bucket;
+  }
+  ++stats.pauses[bucket];
+}
+
+/**
+ * \brief Push the roots onto the gray stack: the registered slots,
+ * the slots found by the scanners if asked, and the remembered cells,
+ * which are kept until their next evacuation since what they point to
+ * in the arenas may in turn point back into the pools.
+ */
+void push_roots(Collector& c, bool scanners)
+{
+  vector<Cell**>& roots = c.roots;
+  for (Cell** slot : c.slots) {
+    roots.push_back(slot);
+  }
+  if (scanners) {
+    for (RootScanner& scan : c.scanners) {
+      scan(roots);
+    }
+  }
+  vector<Cell*>& stack = c.stack;
+  stack.push_back(nil);
+  for (Cell** slot : roots) {
+    stack.push_back(*slot);
+  }
+  roots.clear();
+  stack.insert(stack.end(), c.remembered.begin(), c.remembered.end());
+}
+
+/**
+ * \brief Mark from the gray stack, which is explicit so that deep
+ * trees do not overflow the C++ stack.  Arena cells cannot be marked,
+ * so the ones already traced are kept in a set; they are only traced
+ * when traced is given, in the final pass, since arena cells pushed
+ * during an earlier step may have been released since.
+ * \param c The collector.
+ * \param traced The arena cells traced so far, or NULL to skip them.
+ * \param deadline When to stop, or NULL to mark every gray cell.
+ * \return True iff the gray stack is empty.
+ */
+bool mark(Collector& c, unordered_set<const Cell*>* traced,
+          const chrono::steady_clock::time_point* deadline)
+{
+  vector<Cell*>& stack = c.stack;
+  size_t steps = 0;
+  while (!stack.empty()) {
+    // reading the clock costs more than marking a cell
+    if (NULL != deadline && 0 == ++steps % 256
+        && chrono::steady_clock::now() >= *deadline) {
+      return false;
+    }
+    Cell* cell = stack.back();
+    stack.pop_back();
+    if (immediatep(cell)) {
+      continue;
+    }
+    if (SLAB_ARENA == slab_of(cell)->kind) {
+      if (NULL == traced || !traced->insert(cell).second) {
+        continue;
+      }
+    } else if (!pool_mark(cell)) {
+      continue;
+    }
+    if (CELL_CONS == cell->type()) {
+      stack.push_back(car(cell));
+      stack.push_back(cdr(cell));
+    } else if (CELL_VECTOR == cell->type()) {
+      const VectorCell* v = static_cast<const VectorCell*>(cell);
+      for (size_t i = 0; i < v->size(); ++i) {
+        stack.push_back(v->item(i));
+      }
+    }
+  }
+  return true;
+}
+
+/**
+ * \brief End the marking: mark what is left, then start the sweep.
+ * \param c The collector.
+ */
+void finish_marking(Collector& c)
+{
+  // the cells left gray by the last step are still valid, except for
+  // the arena cells among them
+  bool incremental = gc_marking;
+  mark(c, NULL, NULL);
+  // the slots are not behind the write barrier, so they are marked
+  // again, this time tracing the arena cells they hold; the scanners
+  // only gain trees that are black or shaded after the first pass
+  push_roots(c, !incremental);
+  unordered_set<const Cell*> traced;
+  mark(c, &traced, NULL);
+  gc_marking = false;
+  pool_set_allocate_marked(false);
+  c.frees_at_sweep = pool_stats().frees;
+  pool_sweep_begin();
+  c.sweeping = true;
+}
+
+/**
+ * \brief Sweep a few slabs at a time, ending the collection once every
+ * slab is swept.
+ * \param c The collector.
+ * \param deadline When to stop, or NULL to sweep every slab.
+ */
+void sweep(Collector& c, const chrono::steady_clock::time_point* deadline)
+{
+  while (!pool_sweep_step(finalize, 16)) {
+    if (NULL != deadline && chrono::steady_clock::now() >= *deadline) {
+      return;
+    }
+  }
+  PoolStats after = pool_stats();
+  c.sweeping = false;
+  c.stats.live_bytes = pool_swept_live();
+  c.stats.freed += after.frees - c.frees_at_sweep;
+  c.stats.heap_bytes = (after.slabs - after.released) * SLAB_SIZE;
+  ++c.stats.collections;
+  c.allocated_at_last = pool_allocated_bytes();
+}
+
+/**
+ * \class Evacuation.
+ * \brief Copies the young cells reachable from a set of slots into the
+ * pools.  The copies are scanned breadth first from a queue, as in
+ * Cheney's algorithm; the queue stands in for the to-space, which is
+ * spread over the pool slabs.  Forwarding addresses are kept in a side
+ * table, since cells have no room for them.
+ */
+template <class Young>
+class Evacuation
+{
+public:
+
+  Evacuation(Young young) : young(young) {}
+
+  /**
+   * \brief Evacuate the young cell held in a slot, if any, and point
+   * the slot to the copy.
+   */
+  void slot(Cell** s)
+  {
+    Cell* c = *s;
+    if (immediatep(c) || !young(c)) {
+      return;
+    }
+    auto it = forwarded.find(c);
+    if (forwarded.end() != it) {
+      *s = it->second;
+      return;
+    }
+    Cell* copy = copy_of(c);
+    forwarded.emplace(c, copy);
+    queue.push_back(copy);
+    *s = copy;
+  }
+
+  /**
+   * \brief Evacuate the young children of a cell.
+   */
+  void fields(Cell* c)
+  {
+    if (CELL_VECTOR == c->type()) {
+      VectorCell* v = static_cast<VectorCell*>(c);
+      for (size_t i = 0; i < v->size(); ++i) {
+        Cell* item = v->item(i);
+        slot(&item);
+        v->set_item(i, item);
+      }
+      return;
+    }
+    if (CELL_CONS != c->type()) {
+      return;
+    }
+    ConsCell* cc = static_cast<ConsCell*>(c);
+    Cell* head = cc->head();
+    Cell* tail = cc->tail();
+    slot(&head);
+    slot(&tail);
+    cc->set_head(head);
+    cc->set_tail(tail);
+  }
+
+  /**
+   * \brief Scan the copies until every reachable young cell has been
+   * evacuated.  Copies still pointing into an older part of an arena
+   * are remembered, as the write barrier would have done.
+   * \param remembered The remembered set.
+   * \return The number of cells evacuated.
+   */
+  size_t finish(vector<Cell*>& remembered)
+  {
+    for (size_t i = 0; i < queue.size(); ++i) {
+      fields(queue[i]);
+      if (points_into_arena(queue[i])) {
+        remembered.push_back(queue[i]);
+      }
+    }
+    return queue.size();
+  }
+
+private:
+
+  /**
+   * \brief Make a shallow copy of a cell in the pools.
+   */
+  static Cell* copy_of(const Cell* c)
+  {
+    HeapScope heap;
+    switch (c->type()) {
+    case CELL_INT:
+      return new IntCell(static_cast<const IntCell*>(c)->value());
+    case CELL_DOUBLE:
+      return new DoubleCell(static_cast<const DoubleCell*>(c)->value());
+    case CELL_CONS: {
+      const ConsCell* cc = static_cast<const ConsCell*>(c);
+      return new ConsCell(cc->head(), cc->tail());
+    }
+    default:
+      return c->clone();
+    }
+  }
+
+  Young young;
+  unordered_map<const Cell*, Cell*> forwarded;
+  vector<Cell*> queue;
+};
+
+template <class Young>
+Evacuation<Young> make_evacuation(Young young)
+{
+  return Evacuation<Young>(young);
+}
+
+}
+
+/**
+ * \brief Register the variable.
+ * \param slot The variable holding the root of the tree.
+ */
+GcRoot::GcRoot(Cell*& slot)
+{
+  Collector& c = collector();
+  it = c.slots.insert(c.slots.end(), &slot);
+}
+
+/**
+ * \brief Unregister the variable.
+ */
+GcRoot::~GcRoot()
+{
+  collector().slots.erase(it);
+}
+
+/**
+ * \brief Register the scanner.
+ * \param scan Called at each collection to add roots.
+ */
+GcScanner::GcScanner(const RootScanner& scan)
+{
+  Collector& c = collector();
+  it = c.scanners.insert(c.scanners.end(), scan);
+}
+
+/**
+ * \brief Unregister the scanner.
+ */
+GcScanner::~GcScanner()
+{
+  collector().scanners.erase(it);
+}
+
+/**
+ * \brief Record a cell that was written to point into the young
+ * generation.  Called by the write barrier in cons.hpp.
+ * \param c The cell written to.
+ */
+void gc_remember(Cell* c)
+{
+  collector().remembered.push_back(c);
+}
+
+/**
+ * \brief Shade a cell stored while marking is under way, so that it
+ * is marked in this cycle.  Called by the write barrier in cons.hpp.
+ * \param v The cell stored.
+ */
+void gc_shade(Cell* v)
+{
+  if (pool_marked(v) || SLAB_PERMANENT == slab_of(v)->kind) {
+    return;
+  }
+  // parsing threads may build cells while marking is under way
+  Collector& c = collector();
+  lock_guard<mutex> guard(c.shade_lock);
+  c.stack.push_back(v);
+}
+
+/**
+ * \brief Evacuate the cells allocated in arena since mark that can be
+ * reached from the roots or the remembered cells.
+ * \param arena The arena, whose scope is ending.
+ * \param since The mark taken when the scope began.
+ */
+void gc_evacuate(const Arena& arena, const Arena::Mark& since)
+{
+  Collector& c = collector();
+  if (c.slots.empty() && c.remembered.empty()) {
+    return;
+  }
+  auto start = chrono::steady_clock::now();
+  auto young = [&arena, &since](const Cell* p) {
+    return arena.allocated_since(p, since);
+  };
+  auto ev = make_evacuation(young);
+  for (Cell** slot : c.slots) {
+    ev.slot(slot);
+  }
+  // remembered cells that are young themselves are either evacuated
+  // through some other path or dropped with the arena
+  vector<Cell*> remembered;
+  remembered.swap(c.remembered);
+  for (Cell* cell : remembered) {
+    if (!young(cell)) {
+      ev.fields(cell);
+    }
+  }
+  size_t n = ev.finish(c.remembered);
+  for (Cell* cell : remembered) {
+    if (!young(cell) && points_into_arena(cell)) {
+      c.remembered.push_back(cell);
+    }
+  }
+  if (0 < n) {
+    ++c.stats.evacuations;
+    c.stats.promoted += n;
+  }
+  record_pause(c.stats, start);
+}
+
+/**
+ * \brief Move the young part of a tree into the old generation right
+ * away, so that it outlives the current arena scope.  Cells already in
+ * the pools, immediates, nil and symbols are shared.
+ * \param c The root of the tree.
+ * \return The root of the promoted tree.
+ */
+Cell* promote(Cell* c)
+{
+  Collector& col = collector();
+  auto ev = make_evacuation(in_arena);
+  ev.slot(&c);
+  col.stats.promoted += ev.finish(col.remembered);
+  return c;
+}
+
+/**
+ * \brief Free every heap cell that cannot be reached from the roots,
+ * finishing the incremental collection under way, if any.  Must be
+ * called with no other thread allocating cells.
+ */
+void gc_collect()
+{
+  Collector& c = collector();
+  auto start = chrono::steady_clock::now();
+  if (c.sweeping) {
+    sweep(c, NULL);
+  }
+  finish_marking(c);
+  sweep(c, NULL);
+  record_pause(c.stats, start);
+}
+
+/**
+ * \brief Collect if enough has been allocated since the last
+ * collection: at least GC_MIN_BYTES, and at least as much as was live
+ * after it.  With a pause budget, start or continue an incremental
+ * collection instead.
+ */
+void gc_safepoint()
+{
+  Collector& c = collector();
+  if (!gc_marking && !c.sweeping) {
+    size_t since = pool_allocated_bytes() - c.allocated_at_last;
+    if (since < max(GC_MIN_BYTES, c.stats.live_bytes)) {
+      return;
+    }
+    if (0 >= c.budget_ms) {
+      gc_collect();
+      return;
+    }
+    gc_marking = true;
+    pool_set_allocate_marked(true);
+    push_roots(c, true);
+  }
+  auto start = chrono::steady_clock::now();
+  auto deadline = start + chrono::duration_cast<chrono::steady_clock::duration>(
+    chrono::duration<double, milli>(c.budget_ms));
+  ++c.stats.slices;
+  // out of gray cells, the marking ends at once, which should be short
+  if (gc_marking && mark(c, NULL, &deadline)) {
+    finish_marking(c);
+  }
+  if (c.sweeping) {
+    sweep(c, &deadline);
+  }
+  record_pause(c.stats, start);
+}
+
+/**
+ * \brief Set the longest pause that marking may take at a safe point.
+ * \param ms The budget in milliseconds, or 0 to collect without
+ * stopping, in a single pause.
+ */
+void gc_set_pause_budget(double ms)
+{
+  collector().budget_ms = ms;
+}
+
+/**
+ * \brief Read the collection counters.
+ * \return The counters.
+ */
+GcStats gc_stats()
+{
+  return collector().stats;
+}
@@ -0,0 +1,195 @@
+/**
+ * \file gc.hpp
+ *
+ * Encapsulates the interface for the garbage collector, which manages
+ * two generations.
+ *
+ * The young generation is the expression arena.  When an arena scope
+ * ends, the cells allocated within it that can be reached from the
+ * roots registered with GcRoot, or from cells recorded by the write
+ * barrier, are evacuated: copied breadth first into the pools, with
+ * every pointer to them updated, while the rest are dropped with the
+ * arena.  The work is proportional to the survivors only.
+ *
+ * The old generation is the pools.  Their cells are never freed by
+ * hand; a mark-and-sweep collection frees those that cannot be reached
+ * from the roots.  It only happens at safe points between top-level
+ * expressions.  With a pause budget, marking is incremental: each safe
+ * point marks for at most the budget, and the cycle ends once the gray
+ * cells run out with a final pass over the roots and the sweep.  The
+ * write barrier keeps the tri-color invariant in between, by shading
+ * every cell stored into another while marking is under way.  Cells
+ * made meanwhile are allocated black, and a new cons cell shades its
+ * children, so the final pass only revisits the roots.
+ */
+
+#ifndef GC_HPP
+#define GC_HPP
+
+#include "Cell.hpp"
+#include "arena.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <vector>
+
+/**
+ * \brief Fewest bytes allocated between two collections.
+ */
+const size_t GC_MIN_BYTES = 4 * 1024 * 1024;
+
+/**
+ * \brief Number of buckets in the pause histogram.  Bucket i counts
+ * pauses shorter than GC_PAUSE_BOUNDS_US[i], and the last one all the
+ * longer pauses.
+ */
+const size_t GC_PAUSE_BUCKETS = 6;
+
+/**
+ * \brief Upper bounds of the pause histogram buckets but the last, in
+ * microseconds.
+ */
+constexpr int64_t GC_PAUSE_BOUNDS_US[GC_PAUSE_BUCKETS - 1] = {
+  10, 100, 1000, 10000, 100000
+};
+
+/**
+ * \brief Adds the variables holding roots in some container to the
+ * list of root slots.  The trees found this way must be in the old
+ * generation, e.g. made with promote().  While marking, the container
+ * is only scanned when the cycle begins, so a tree added to it then
+ * must be new or passed to gc_shade().
+ */
+typedef std::function<void(std::vector<Cell**>&)> RootScanner;
+
+/**
+ * \class GcRoot.
+ * \brief Keeps the tree held in a variable alive for the lifetime of
+ * the scope, in either generation.  The variable is updated when the
+ * tree is evacuated.
+ */
+class GcRoot
+{
+public:
+
+  /**
+   * \brief Register the variable.
+   * \param slot The variable holding the root of the tree.
+   */
+  GcRoot(Cell*& slot);
+
+  /**
+   * \brief Unregister the variable.
+   */
+  ~GcRoot();
+
+private:
+  std::list<Cell**>::iterator it;
+};
+
+/**
+ * \class GcScanner.
+ * \brief Keeps the trees found by a scanner alive for the lifetime of
+ * the scanner object.
+ */
+class GcScanner
+{
+public:
+
+  /**
+   * \brief Register the scanner.
+   * \param scan Called at each collection to add roots.
+   */
+  GcScanner(const RootScanner& scan);
+
+  /**
+   * \brief Unregister the scanner.
+   */
+  ~GcScanner();
+
+private:
+  std::list<RootScanner>::iterator it;
+};
+
+/**
+ * \brief Collection counters.
+ */
+struct GcStats {
+  size_t collections;       ///< mark-and-sweep collections so far
+  size_t freed;             ///< cells freed so far
+  size_t live_bytes;        ///< bytes still allocated after the last one
+  size_t evacuations;       ///< evacuations with survivors so far
+  size_t promoted;          ///< cells evacuated into the pools so far
+  size_t slices;            ///< incremental marking steps so far
+  size_t heap_bytes;        ///< bytes held in pool slabs after the last one
+  double max_pause_ms;      ///< longest collection or evacuation
+  size_t pauses[GC_PAUSE_BUCKETS]; ///< histogram of the pauses
+};
+
+/**
+ * \brief True while an incremental collection is marking.  Read by
+ * the write barrier in cons.hpp.
+ */
+extern bool gc_marking;
+
+/**
+ * \brief Set the longest pause that marking may take at a safe point.
+ * \param ms The budget in milliseconds, or 0 to collect without
+ * stopping, in a single pause.
+ */
+void gc_set_pause_budget(double ms);
+
+/**
+ * \brief Record a cell that was written to point into the young
+ * generation.  Called by the write barrier in cons.hpp.
+ * \param c The cell written to.
+ */
+void gc_remember(Cell* c);
+
+/**
+ * \brief Shade a cell stored while marking is under way, so that it
+ * is marked in this cycle.  Called by the write barrier in cons.hpp.
+ * \param v The cell stored.
+ */
+void gc_shade(Cell* v);
+
+/**
+ * \brief Evacuate the cells allocated in arena since mark that can be
+ * reached from the roots or the remembered cells.
+ * \param arena The arena, whose scope is ending.
+ * \param since The mark taken when the scope began.
+ */
+void gc_evacuate(const Arena& arena, const Arena::Mark& since);
+
+/**
+ * \brief Move the young part of a tree into the old generation right
+ * away, so that it outlives the current arena scope.  Cells already in
+ * the pools, immediates, nil and symbols are shared.
+ * \param c The root of the tree.
+ * \return The root of the promoted tree.
+ */
+Cell* promote(Cell* c);
+
+/**
+ * \brief Free every heap cell that cannot be reached from the roots,
+ * finishing the incremental collection under way, if any.  Must be
+ * called with no other thread allocating cells.
+ */
+void gc_collect();
+
+/**
+ * \brief Collect if enough has been allocated since the last
+ * collection: at least GC_MIN_BYTES, and at least as much as was live
+ * after it.  With a pause budget, start or continue an incremental
+ * collection instead.
+ */
+void gc_safepoint();
+
+/**
+ * \brief Read the collection counters.
+ * \return The counters.
+ */
+GcStats gc_stats();
+
+#endif // GC_HPP
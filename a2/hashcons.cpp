@@ -0,0 +1,338 @@
+/**
+ * \file hashcons.cpp
+ *
+ * Implementation of hash-consing.  The table holds the canonical cells
+ * themselves, hashed and compared by their content.
+ */
+
+#include "hashcons.hpp"
+#include "arena.hpp"
+#include "cons.hpp"
+#include "gc.hpp"
+#include "pool.hpp"
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+thread_local bool hash_consing = false;
+
+namespace {
+
+/**
+ * \brief The bits of a double, so that values are told apart exactly.
+ */
+uint64_t double_bits(double d)
+{
+  uint64_t bits;
+  memcpy(&bits, &d, sizeof bits);
+  return bits;
+}
+
+/**
+ * \brief Scramble the bits of a word (the MurmurHash3 finalizer), so
+ * that both the top bits, which pick a shard, and the bottom bits,
+ * which pick a slot, depend on all of it.
+ */
+inline uint64_t mix(uint64_t h)
+{
+  h ^= h >> 33;
+  h *= 0xFF51AFD7ED558CCDull;
+  h ^= h >> 33;
+  h *= 0xC4CEB9FE1A85EC53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+/**
+ * \brief The content of a cell, one level deep.  The children of a
+ * canonical cons cell are canonical, so they are compared by address.
+ */
+struct Key {
+  CellType type;
+  uint64_t a;
+  uint64_t b;
+
+  bool operator==(const Key& k) const
+  {
+    return type == k.type && a == k.a && b == k.b;
+  }
+
+  uint64_t hash() const
+  {
+    return mix((a * 0x9E3779B97F4A7C15ull ^ b) + type);
+  }
+};
+
+Key key_of(const Cell* c)
+{
+  Key k = { c->type(), 0, 0 };
+  switch (c->type()) {
+  case CELL_CONS:
+    k.a = reinterpret_cast<uintptr_t>(static_cast<const ConsCell*>(c)->head());
+    k.b = reinterpret_cast<uintptr_t>(static_cast<const ConsCell*>(c)->tail());
+    break;
+  case CELL_INT:
+    k.a = static_cast<const IntCell*>(c)->value();
+    break;
+  case CELL_DOUBLE:
+    k.a = double_bits(static_cast<const DoubleCell*>(c)->value());
+    break;
+  default:
+    k.a = reinterpret_cast<uintptr_t>(c);
+  }
+  return k;
+}
+
+/**
+ * \brief Marks a slot whose cell was dropped, so that probing goes on
+ * past it.  Cells are 8-byte aligned, so no cell has this address.
+ */
+Cell* const TOMBSTONE = reinterpret_cast<Cell*>(1);
+
+/**
+ * \brief Number of shards, each with its own lock, so that parsing
+ * threads seldom wait for each other.  The top bits of a hash pick the
+ * shard.
+ */
+const size_t SHARD_BITS = 6;
+
+/**
+ * \brief One shard of the table: an open-addressing set of canonical
+ * cells with linear probing, kept at most half full.
+ */
+struct alignas(CACHE_LINE) Shard {
+  mutex lock;
+  vector<Cell*> slots = vector<Cell*>(64);
+  size_t used = 0;   ///< slots holding a cell or a tombstone
+  size_t live = 0;   ///< slots holding a cell
+  size_t hits = 0;
+  size_t misses = 0;
+
+  /**
+   * \brief Find the slot of the cell with content k, or else the empty
+   * slot where it would go.
+   */
+  size_t find(const Key& k, uint64_t h) const
+  {
+    size_t mask = slots.size() - 1;
+    for (size_t i = h & mask; ; i = (i + 1) & mask) {
+      Cell* c = slots[i];
+      if (NULL == c || (TOMBSTONE != c && key_of(c) == k)) {
+        return i;
+      }
+    }
+  }
+
+  /**
+   * \brief Add a cell known to be absent, growing the slots, or just
+   * clearing the tombstones, when more than half are used.
+   */
+  void insert(Cell* c, const Key& k, uint64_t h)
+  {
+    if (2 * (used + 1) > slots.size()) {
+      vector<Cell*> old(4 * (live + 1) > slots.size() ? 2 * slots.size() : slots.size());
+      old.swap(slots);
+      used = live = 0;
+      for (Cell* x : old) {
+        if (NULL != x && TOMBSTONE != x) {
+          Key xk = key_of(x);
+          insert(x, xk, xk.hash());
+        }
+      }
+    }
+    size_t i = find(k, h);
+    slots[i] = c;
+    ++used;
+    ++live;
+  }
+
+  /**
+   * \brief Drop the cell in a slot.
+   */
+  void erase(size_t i)
+  {
+    slots[i] = TOMBSTONE;
+    --live;
+  }
+};
+
+/**
+ * \brief The canonical cells.  Never destroyed, so cells may be freed
+ * during exit.
+ */
+struct HashConsTable {
+  Shard shards[1 << SHARD_BITS];
+};
+
+HashConsTable& table()
+{
+  static HashConsTable* t = new HashConsTable;
+  return *t;
+}
+
+Shard& shard_of(uint64_t h)
+{
+  return table().shards[h >> (64 - SHARD_BITS)];
+}
+
+/**
+ * \brief Check if a cell may be shared as a canonical child.
+ */
+inline bool canonicalp(const Cell* c)
+{
+  return immediatep(c) || nil == c || CELL_SYMBOL == c->type() || c->is_canonical();
+}
+
+/**
+ * \brief Hand out a canonical cell found in the table.  While marking,
+ * it may still be white, and is about to be stored somewhere the
+ * collector has already scanned.
+ */
+Cell* found(Shard& s, Cell* c)
+{
+  ++s.hits;
+  if (gc_marking) {
+    gc_shade(c);
+  }
+  return c;
+}
+
+/**
+ * \brief Find the canonical cell with content k, or make one.
+ * \param k The wanted content.
+ * \param make Makes a new cell with that content.
+ * \return The canonical cell.
+ */
+template <class Make>
+Cell* canonical(const Key& k, Make make)
+{
+  uint64_t h = k.hash();
+  Shard& s = shard_of(h);
+  {
+    lock_guard<mutex> guard(s.lock);
+    size_t i = s.find(k, h);
+    Cell* c = s.slots[i];
+    if (NULL != c) {
+      if (!pool_condemned(c)) {
+        return found(s, c);
+      }
+      // the sweep under way is about to free it
+      s.erase(i);
+    }
+  }
+  // allocate without the lock, since the sweep calls hash_forget()
+  // with the pool lock held
+  Cell* c;
+  {
+    HeapScope heap;
+    c = make();
+  }
+  c->set_canonical();
+  lock_guard<mutex> guard(s.lock);
+  size_t i = s.find(k, h);
+  if (NULL != s.slots[i]) {
+    // another thread made it first; this copy is left to the collector
+    return found(s, s.slots[i]);
+  }
+  s.insert(c, k, h);
+  ++s.misses;
+  return c;
+}
+
+}
+
+/**
+ * \brief Turn hash-consing on or off.
+ * \param enable True to return canonical cells.
+ */
+HashConsScope::HashConsScope(bool enable) : previous(hash_consing)
+{
+  hash_consing = enable;
+}
+
+/**
+ * \brief Restore the previous setting.
+ */
+HashConsScope::~HashConsScope()
+{
+  hash_consing = previous;
+}
+
+/**
+ * \brief Find the canonical cons cell of a pair, creating it on first
+ * use.  If a child is not canonical itself, a plain cell is made
+ * instead.  Safe to call from several threads.
+ * \param car The car.
+ * \param cdr The cdr.
+ * \return The cell.
+ */
+Cell* hash_cons(Cell* car, Cell* cdr)
+{
+  if (!canonicalp(car) || !canonicalp(cdr)) {
+    return new ConsCell(car, cdr);
+  }
+  Key k = { CELL_CONS, reinterpret_cast<uintptr_t>(car), reinterpret_cast<uintptr_t>(cdr) };
+  return canonical(k, [=]() { return new ConsCell(car, cdr); });
+}
+
+/**
+ * \brief Find the canonical boxed int cell of a value, creating it on
+ * first use.  Safe to call from several threads.
+ * \param i The value.
+ * \return The cell.
+ */
+Cell* hash_int(int64_t i)
+{
+  Key k = { CELL_INT, static_cast<uint64_t>(i), 0 };
+  return canonical(k, [=]() { return new IntCell(i); });
+}
+
+/**
+ * \brief Find the canonical double cell of a value, creating it on
+ * first use.  Values are compared by bits, so 0.0 and -0.0 differ.
+ * Safe to call from several threads.
+ * \param d The value.
+ * \return The cell.
+ */
+Cell* hash_double(double d)
+{
+  Key k = { CELL_DOUBLE, double_bits(d), 0 };
+  return canonical(k, [=]() { return new DoubleCell(d); });
+}
+
+/**
+ * \brief Drop a canonical cell from the table.  Called by the collector
+ * before it frees the cell.
+ * \param c The cell.
+ */
+void hash_forget(Cell* c)
+{
+  Key k = key_of(c);
+  uint64_t h = k.hash();
+  Shard& s = shard_of(h);
+  lock_guard<mutex> guard(s.lock);
+  size_t i = s.find(k, h);
+  // an equal cell may have replaced it already
+  if (s.slots[i] == c) {
+    s.erase(i);
+  }
+}
+
+/**
+ * \brief Read the hash-consing counters.
+ * \return The counters.
+ */
+HashConsStats hash_cons_stats()
+{
+  HashConsStats total = { 0, 0, 0 };
+  for (Shard& s : table().shards) {
+    lock_guard<mutex> guard(s.lock);
+    total.hits += s.hits;
+    total.misses += s.misses;
+    total.size += s.live;
+  }
+  return total;
+}
@@ -0,0 +1,99 @@
+/**
+ * \file hashcons.hpp
+ *
+ * Encapsulates the interface for hash-consing, which keeps one
+ * canonical cell per cons pair and per boxed number, so that repeated
+ * subtrees are stored once and structurally equal canonical trees are
+ * the same pointer.
+ *
+ * Hash-consing is opt-in, per thread, for the lifetime of a
+ * HashConsScope.  Canonical cells are allocated in the pools, never in
+ * an arena, and must not be mutated.  The table is weak: it does not
+ * keep its cells alive, and the collector drops the cells it frees.
+ */
+
+#ifndef HASHCONS_HPP
+#define HASHCONS_HPP
+
+#include "Cell.hpp"
+#include <cstddef>
+
+/**
+ * \brief True while cons(), make_int() and make_double() return
+ * canonical cells on this thread.
+ */
+extern thread_local bool hash_consing;
+
+/**
+ * \class HashConsScope.
+ * \brief Turns hash-consing on or off for the lifetime of the scope.
+ */
+class HashConsScope
+{
+public:
+
+  /**
+   * \brief Turn hash-consing on or off.
+   * \param enable True to return canonical cells.
+   */
+  HashConsScope(bool enable);
+
+  /**
+   * \brief Restore the previous setting.
+   */
+  ~HashConsScope();
+
+private:
+  bool previous;
+};
+
+/**
+ * \brief Find the canonical cons cell of a pair, creating it on first
+ * use.  If a child is not canonical itself, a plain cell is made
+ * instead.  Safe to call from several threads.
+ * \param car The car.
+ * \param cdr The cdr.
+ * \return The cell.
+ */
+Cell* hash_cons(Cell* car, Cell* cdr);
+
+/**
+ * \brief Find the canonical boxed int cell of a value, creating it on
+ * first use.  Safe to call from several threads.
+ * \param i The value.
+ * \return The cell.
+ */
+Cell* hash_int(int64_t i);
+
+/**
+ * \brief Find the canonical double cell of a value, creating it on
+ * first use.  Values are compared by bits, so 0.0 and -0.0 differ.
+ * Safe to call from several threads.
+ * \param d The value.
+ * \return The cell.
+ */
+Cell* hash_double(double d);
+
+/**
+ * \brief Drop a canonical cell from the table.  Called by the collector
+ * before it frees the cell.
+ * \param c The cell.
+ */
+void hash_forget(Cell* c);
+
+/**
+ * \brief Hash-consing counters.
+ */
+struct HashConsStats {
+  size_t hits;     ///< lookups that found a canonical cell
+  size_t misses;   ///< lookups that made one
+  size_t size;     ///< canonical cells in the table
+};
+
+/**
+ * \brief Read the hash-consing counters.
+ * \return The counters.
+ */
+HashConsStats hash_cons_stats();
+
+#endif // HASHCONS_HPP
@@ -0,0 +1,66 @@
+/**
+ * \file intern.cpp
+ *
+ * Implementation of the symbol table.  Every symbol name is stored
+ * once, in its canonical cell, and the table is keyed by views of
+ * those names.
+ */
+
+#include "intern.hpp"
+#include "pool.hpp"
+#include <new>
+#include <mutex>
+#include <unordered_map>
+
+using namespace std;
+
+namespace {
+
+/**
+ * \brief The symbol table and the lock that guards it.  Built on
+ * first use, so symbols can be interned during static initialization.
+ */
+struct SymbolTable {
+  mutex lock;
+  unordered_map<string_view, SymbolCell*> symbols;
+};
+
+SymbolTable& table()
+{
+  static SymbolTable* t = new SymbolTable;
+  return *t;
+}
+
+}
+
+/**
+ * \brief Find the canonical symbol cell for a name, creating it on
+ * first use.  Safe to call from several threads.
+ * \param name The symbol name.
+ * \return The symbol cell; it lives until the process exits.
+ */
+Cell* intern(string_view name)
+{
+  SymbolTable& t = table();
+  lock_guard<mutex> guard(t.lock);
+  unordered_map<string_view, SymbolCell*>::iterator it = t.symbols.find(name);
+  if (it != t.symbols.end()) {
+    return it->second;
+  }
+  // symbols live as long as the process, so they are kept out of the
+  // arenas and out of the collector's way
+  SymbolCell* symbol = ::new (permanent_allocate(sizeof(SymbolCell))) SymbolCell(name);
+  t.symbols.emplace(symbol->name(), symbol);
+  return symbol;
+}
+
+/**
+ * \brief Count the distinct symbols interned so far.
+ * \return The number of symbols.
+ */
+size_t interned_count()
+{
+  SymbolTable& t = table();
+  lock_guard<mutex> guard(t.lock);
+  return t.symbols.size();
+}
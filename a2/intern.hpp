@@ -0,0 +1,29 @@
+/**
+ * \file intern.hpp
+ *
+ * Encapsulates the interface for the symbol table, which keeps one
+ * canonical symbol cell per name for the whole process, so that
+ * symbols can be compared by pointer.
+ */
+
+#ifndef INTERN_HPP
+#define INTERN_HPP
+
+#include "Cell.hpp"
+#include <string_view>
+
+/**
+ * \brief Find the canonical symbol cell for a name, creating it on
+ * first use.  Safe to call from several threads.
+ * \param name The symbol name.
+ * \return The symbol cell; it lives until the process exits.
+ */
+Cell* intern(std::string_view name);
+
+/**
+ * \brief Count the distinct symbols interned so far.
+ * \return The number of symbols.
+ */
+size_t interned_count();
+
+#endif // INTERN_HPP
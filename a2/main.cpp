@@ -9,131 +9,281 @@
 
 #include "parse.hpp"
 #include "eval.hpp"
+#include "scan.hpp"
+#include "binary.hpp"
+#include "cache.hpp"
+#include "hashcons.hpp"
+#include "arena.hpp"
+#include "gc.hpp"
 #include <sstream>
+#include <cstring>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <iterator>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace std;
 
 /**
- * \brief Parse and evaluate the s-expression, and print the result.
- * \param sexpr The string vaule holding the s-expression.
+ * \brief Size of the blocks pulled from the input stream in batch mode.
  */
-void parse_eval_print(string sexpr)
+const size_t READ_BLOCK_SIZE = 64 * 1024;
+
+/**
+ * \brief Number of top-level expressions parsed in parallel before
+ * they are evaluated, which bounds the memory held by parsed trees.
+ */
+const size_t PARSE_WINDOW = 64 * 1024;
+
+/**
+ * \brief Most parsing threads per core that --jobs may ask for; larger
+ * counts are cut down to this.
+ */
+const unsigned JOBS_PER_CORE = 4;
+
+/**
+ * \brief Callback receiving each complete top-level s-expression found
+ * by the scanner, as the characters between its two arguments.
+ */
+typedef function<void(const char*, const char*)> ExprHandler;
+
+/**
+ * \brief The parse-result cache, or NULL when caching is off.
+ */
+ParseCache* parsecache = NULL;
+
+/**
+ * \brief Whether parse trees are hash-consed, so that repeated
+ * subtrees are shared.
+ */
+bool hashcons = false;
+
+/**
+ * \brief The arena holding the cells of the expression being
+ * evaluated, released as soon as its result is printed.
+ */
+Arena exprarena;
+
+/**
+ * \brief Evaluate a parse tree and print the result.  This is the safe
+ * point where garbage is collected, before evaluation starts.  Every
+ * cell made during evaluation is released afterwards.
+ * \param root The root of the parse tree.
+ */
+void eval_print(Cell* root)
 {
-  Cell* root = parse(sexpr);
+  {
+    GcRoot keep(root);
+    gc_safepoint();
+  }
+  // only parse trees are hash-consed, not the cells made by evaluation
+  HashConsScope plain(false);
+  ArenaScope scope(exprarena);
   Cell* result = eval(root);
   if ( result == nil ) {
     cout << "()" << endl;
   } else {
-    cout << *result << endl;
-  }
-  if (result != nil) {
-    delete result;
+    print_cell(cout, result);
+    cout << endl;
   }
 }
 
 /**
- * \brief Read single single symbol into the end of a string buffer.
- * \param fin The input file stream.
- * \param str The string buffer.
+ * \brief Parse and evaluate the s-expression held in the characters
+ * between begin and end, and print the result.
+ * \param begin The first character of the s-expression.
+ * \param end One past the last character of the s-expression.
  */
-void readsinglesymbol(ifstream& fin, string& str)
+void parse_eval_print(const char* begin, const char* end)
 {
-  char currentchar;
-  fin.get(currentchar);
-  if (fin.eof()) {
+  ArenaScope scope(exprarena);
+  HashConsScope shared(hashcons);
+  if (NULL == parsecache) {
+    eval_print(parse(begin, end));
     return;
   }
-  if (currentchar == '\"') {
-    // read a string literal
-    do {
-      str += currentchar;
-      fin.get(currentchar);
-    } while (currentchar != '\"');
-    str += currentchar;
-  } else {
-    do {
-      str += currentchar;
-      fin.get(currentchar);
-    } while ((false == iswhitespace(currentchar)) 
-	     && ('(' != currentchar) 
-	     && (false == fin.eof()));
-    fin.putback(currentchar);  
+  string_view text(begin, end - begin);
+  Cell* root = parsecache->find(text);
+  if (NULL == root) {
+    try {
+      root = promote(parse_quiet(begin, end));
+      parsecache->insert(text, root);
+    } catch (runtime_error&) {
+      // malformed text is never cached, so its error is reported each time
+      root = parse(begin, end);
+    }
   }
+  eval_print(root);
 }
 
 /**
- * \brief Read, parse, evaluate, and print the expression one by one from
- * the input stream.
- *
- * \param fin The input file stream.
+ * \brief Parse and evaluate the s-expression, and print the result.
+ * \param sexpr The string vaule holding the s-expression.
  */
-void readfile(ifstream& fin)
+void parse_eval_print(string sexpr)
 {
-  string sexp;
+  parse_eval_print(sexpr.data(), sexpr.data() + sexpr.size());
+}
+
+/**
+ * \brief Expression handler that parses, evaluates and prints each
+ * expression as soon as it is found.
+ */
+const ExprHandler parse_each = [](const char* begin, const char* end) {
+  parse_eval_print(begin, end);
+};
+
+/**
+ * \brief Position and state of the top-level expression scanner, kept
+ * across the blocks of one input.
+ */
+struct ScanState
+{
+  // start of the current s-expression, and the next unscanned character
+  size_t start = 0;
+  size_t pos = 0;
   bool isstartsexp = false;
+  bool issymbol = false;
+  bool isstring = false;
   int inumleftparenthesis = 0;
+};
 
-  // check whether to read the end
-  while (!fin.eof()) {
-    // read char by char
-    char currentchar;
-    fin.get(currentchar);
-    if (fin.eof()) {
+/**
+ * \brief Scan buf up to size for top-level expression boundaries, and
+ * pass every complete expression to emit in place.
+ *
+ * Scanning resumes at st.pos.  On return st.start is the first
+ * character of the expression still unfinished at the end of buf.
+ *
+ * \param buf The input characters.
+ * \param size The number of characters in buf.
+ * \param st The scanner state.
+ * \param emit The handler for complete expressions.
+ */
+void scanblock(const char* const buf, const size_t size, ScanState& st,
+               const ExprHandler& emit)
+{
+  const char* const end = buf + size;
+  ScanIndex index(end);
+  while (st.pos < size) {
+    // jump straight to the next character that can change the state
+    unsigned kinds;
+    if (st.isstring) {
+      // inside a string literal only the closing quote matters
+      kinds = SCAN_QUOTE;
+    } else if (st.issymbol) {
+      // a single symbol ends at whitespace or a left parenthesis
+      kinds = SCAN_SPACE | SCAN_OPEN;
+    } else if (false == st.isstartsexp) {
+      // skip some white space before new s-expression occurs
+      kinds = SCAN_NONSPACE;
+    } else {
+      // quotes inside a list are left for the parser to check, so a
+      // stray one cannot swallow the rest of the input
+      kinds = SCAN_OPEN | SCAN_CLOSE;
+    }
+    st.pos = index.find(buf + st.pos, kinds) - buf;
+    if (st.pos == size) {
+      if (false == st.isstartsexp) {
+        // nothing but white space is left over
+        st.start = size;
+      }
       break;
     }
 
-    // skip some white space before new s-expression occurs
-    if ((true == iswhitespace(currentchar))&&(false == isstartsexp)) {
+    char currentchar = buf[st.pos];
+    if (st.isstring) {
+      st.isstring = false;
+      st.isstartsexp = false;
+      emit(buf + st.start, buf + st.pos + 1);
+      st.start = st.pos + 1;
+    } else if (st.issymbol) {
+      st.issymbol = false;
+      st.isstartsexp = false;
+      emit(buf + st.start, buf + st.pos);
+      st.start = st.pos;
+      // let the terminating character start the next s-expression
       continue;
-    }
-    // run across a new s-expression
-    if ((false == isstartsexp)&&(false == iswhitespace(currentchar))) {
-      // check whether single symbol
-      if ('(' != currentchar)	{
-	// read a single symbol
-	fin.putback(currentchar);
-	readsinglesymbol(fin, sexp);
-	// call function
-	parse_eval_print(sexp);
-	sexp.clear();
-      }	else {
-	// start new expression
-	isstartsexp = true;
-	// read left parenthesis
-	sexp += currentchar;
-	inumleftparenthesis = 1;
+    } else if (false == st.isstartsexp) {
+      // run across a new s-expression
+      st.isstartsexp = true;
+      st.start = st.pos;
+      if ('(' == currentchar) {
+        st.inumleftparenthesis = 1;
+      } else if ('\"' == currentchar) {
+        st.isstring = true;
+      } else {
+        st.issymbol = true;
       }
+    } else if ('(' == currentchar) {
+      // count left parenthesis
+      st.inumleftparenthesis ++;
     } else {
-      // in the process of reading the current s-expression
-      if (true == isstartsexp) {
-	if (true == iswhitespace(currentchar)) {
-	  // append a blankspace
-	  //sexp += ' ';
-	  sexp += currentchar;
-	} else {
-	  // append current character
-	  sexp += currentchar;
-	  // count left parenthesis
-	  if ('(' == currentchar) {
-	    inumleftparenthesis ++;
-	  }
-	  if (')' == currentchar) {
-	    inumleftparenthesis --;
-	    // check whether current s-expression ends
-	    if (0 == inumleftparenthesis) {
-	      // current s-expression ends
-	      isstartsexp  =  false;
-	      // call functions
-	      parse_eval_print(sexp);
-	      sexp.clear();
-	    }
-	  }
-	}
+      st.inumleftparenthesis --;
+      // check whether current s-expression ends
+      if (0 == st.inumleftparenthesis) {
+        st.isstartsexp = false;
+        emit(buf + st.start, buf + st.pos + 1);
+        st.start = st.pos + 1;
       }
     }
+    ++st.pos;
+  }
+}
+
+/**
+ * \brief Finish scanning at the end of the input, where a single
+ * symbol may still be pending.
+ * \param buf The input characters.
+ * \param size The number of characters in buf.
+ * \param st The scanner state.
+ * \param emit The handler for complete expressions.
+ */
+void scanfinish(const char* const buf, const size_t size, ScanState& st,
+                const ExprHandler& emit)
+{
+  if (st.issymbol) {
+    emit(buf + st.start, buf + size);
   }
 }
 
+/**
+ * \brief Read, parse, evaluate, and print the expression one by one from
+ * the input stream.
+ *
+ * The stream is read in large blocks.  Top-level expression boundaries
+ * are found by a single scan over each block, and every complete
+ * expression is handed to the parser straight out of the block.  Only
+ * an expression left unfinished at the end of a block is moved to the
+ * front of the buffer before the next block is appended to it.
+ *
+ * \param fin The input stream.
+ */
+void readfile(istream& fin)
+{
+  vector<char> buf;
+  ScanState st;
+
+  while (fin) {
+    // keep the unfinished s-expression and append the next block
+    buf.erase(buf.begin(), buf.begin() + st.start);
+    st.pos -= st.start;
+    st.start = 0;
+    size_t used = buf.size();
+    buf.resize(used + READ_BLOCK_SIZE);
+    fin.read(&buf[used], READ_BLOCK_SIZE);
+    buf.resize(used + fin.gcount());
+    scanblock(buf.data(), buf.size(), st, parse_each);
+  }
+  scanfinish(buf.data(), buf.size(), st, parse_each);
+}
+
 /**
  * \brief Read the expressions from the file.
  * \param fn The file name.
@@ -145,6 +295,387 @@ void readfile(char* fn)
   fin.close();
 }
 
+/**
+ * \brief Map a file read-only into memory.
+ * \param fn The file name.
+ * \param buf Set to the first character of the mapping, or NULL for an
+ * empty file.
+ * \param size Set to the size of the file.
+ * \return False if the file cannot be mapped, e.g. because it is a pipe.
+ */
+bool mapfile(char* fn, const char*& buf, size_t& size)
+{
+  int fd = open(fn, O_RDONLY);
+  if (fd < 0) {
+    cerr << "ERROR: Cannot open file '" << fn << "'.\n";
+    exit(1);
+  }
+  struct stat sb;
+  if (fstat(fd, &sb) < 0 || !S_ISREG(sb.st_mode)) {
+    close(fd);
+    return false;
+  }
+  buf = NULL;
+  size = sb.st_size;
+  if (size > 0) {
+    void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+      close(fd);
+      return false;
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+    buf = static_cast<const char*>(map);
+  }
+  close(fd);
+  return true;
+}
+
+/**
+ * \brief Unmap a file mapped by mapfile.
+ * \param buf The first character of the mapping.
+ * \param size The size of the file.
+ */
+void unmapfile(const char* buf, size_t size)
+{
+  if (size > 0) {
+    munmap(const_cast<char*>(buf), size);
+  }
+}
+
+/**
+ * \brief Read the expressions from the file by mapping it read-only
+ * into memory, so the parser works directly on the mapped bytes and
+ * the kernel pages the file in as the scan reaches it.  Falls back to
+ * the stream reader for inputs that cannot be mapped, such as pipes.
+ * \param fn The file name.
+ */
+void readfile_mmap(char* fn)
+{
+  const char* buf;
+  size_t size;
+  if (!mapfile(fn, buf, size)) {
+    readfile(fn);
+    return;
+  }
+  ScanState st;
+  scanblock(buf, size, st, parse_each);
+  scanfinish(buf, size, st, parse_each);
+  unmapfile(buf, size);
+}
+
+/**
+ * \brief Parse a slice of the expressions of a window in quiet mode,
+ * as one worker thread.
+ * \param buf The input characters.
+ * \param ranges The start and end offsets of every expression.
+ * \param first The first expression of the slice.
+ * \param last One past the last expression of the slice.
+ * \param trees Receives the parse tree of every expression.
+ * \param failed Receives whether each expression was malformed.
+ */
+void parse_slice(const char* buf, const vector<pair<size_t, size_t> >& ranges,
+                 size_t first, size_t last,
+                 vector<Cell*>& trees, vector<char>& failed)
+{
+  HashConsScope shared(hashcons);
+  for (size_t i = first; i < last; ++i) {
+    try {
+      trees[i] = parse_quiet(buf + ranges[i].first, buf + ranges[i].second);
+      failed[i] = false;
+    } catch (runtime_error&) {
+      failed[i] = true;
+    }
+  }
+}
+
+/**
+ * \brief The worker threads of readfile_parallel, started once for the
+ * whole file and handed one window of expressions after another.
+ * Between windows they wait, so the main thread may refill the ranges
+ * and resize the results, and may collect garbage.
+ */
+class ParseWorkers
+{
+public:
+  /**
+   * \brief Start the workers.
+   * \param buf The input characters.
+   * \param ranges The start and end offsets of the window's expressions.
+   * \param trees Receives the parse tree of every expression.
+   * \param failed Receives whether each expression was malformed.
+   * \param jobs The number of threads to parse with, counting the
+   * caller's.
+   */
+  ParseWorkers(const char* buf, const vector<pair<size_t, size_t> >& ranges,
+               vector<Cell*>& trees, vector<char>& failed, unsigned jobs)
+    : buf(buf), ranges(ranges), trees(trees), failed(failed), jobs(jobs)
+  {
+    for (unsigned k = 1; k < jobs; ++k) {
+      threads.push_back(thread(&ParseWorkers::work, this, k));
+    }
+  }
+
+  /**
+   * \brief Stop the workers.
+   */
+  ~ParseWorkers()
+  {
+    {
+      lock_guard<mutex> guard(lock);
+      quit = true;
+    }
+    start.notify_all();
+    for (size_t i = 0; i < threads.size(); ++i) {
+      threads[i].join();
+    }
+  }
+
+  /**
+   * \brief Parse the window, every thread taking a slice of it, the
+   * caller the first.  Returns once all the slices are parsed.
+   */
+  void parse()
+  {
+    {
+      lock_guard<mutex> guard(lock);
+      slice = (ranges.size() + jobs - 1) / jobs;
+      busy = threads.size();
+      ++window;
+    }
+    start.notify_all();
+    parse_slice(buf, ranges, 0, min(slice, ranges.size()), trees, failed);
+    unique_lock<mutex> guard(lock);
+    done.wait(guard, [this]() { return 0 == busy; });
+  }
+
+private:
+  /**
+   * \brief Parse slice k of each window until told to quit.
+   */
+  void work(unsigned k)
+  {
+    size_t seen = 0;
+    for (;;) {
+      {
+        unique_lock<mutex> guard(lock);
+        start.wait(guard, [&]() { return quit || window != seen; });
+        if (quit) {
+          return;
+        }
+        seen = window;
+      }
+      size_t first = min(k * slice, ranges.size());
+      parse_slice(buf, ranges, first, min(first + slice, ranges.size()),
+                  trees, failed);
+      lock_guard<mutex> guard(lock);
+      if (0 == --busy) {
+        done.notify_one();
+      }
+    }
+  }
+
+  const char* buf;
+  const vector<pair<size_t, size_t> >& ranges;
+  vector<Cell*>& trees;
+  vector<char>& failed;
+  unsigned jobs;
+  vector<thread> threads;
+  mutex lock;
+  condition_variable start;  ///< a window is ready, or it is time to quit
+  condition_variable done;   ///< the last worker finished its slice
+  size_t window = 0;         ///< the number of windows handed out
+  size_t slice = 0;          ///< the expressions in each slice
+  size_t busy = 0;           ///< the workers still parsing
+  bool quit = false;
+};
+
+/**
+ * \brief Read the expressions from the file, parsing them on several
+ * threads.
+ *
+ * The mapped file is scanned for top-level expression boundaries only
+ * until a window of expressions is complete.  Each window is divided
+ * among the threads, which parse their slices independently, and the
+ * trees are evaluated and printed in source order.  A malformed
+ * expression is parsed again on the main thread when its turn comes,
+ * so its error message and any exit happen exactly where they would in
+ * a serial run.  The pages of the file before the next window are then
+ * dropped, so the memory held stays the same however long the file.
+ *
+ * \param fn The file name.
+ * \param jobs The number of threads to parse with.
+ */
+void readfile_parallel(char* fn, unsigned jobs)
+{
+  const char* buf;
+  size_t size;
+  if (!mapfile(fn, buf, size)) {
+    readfile(fn);
+    return;
+  }
+
+  vector<pair<size_t, size_t> > ranges;
+  ScanState st;
+  ExprHandler collect = [&](const char* b, const char* e) {
+    ranges.push_back(make_pair(b - buf, e - buf));
+  };
+
+  vector<Cell*> trees;
+  vector<char> failed;
+  // parsed trees waiting to be evaluated are collection roots
+  size_t pending = 0, pendingend = 0;
+  GcScanner roots([&](vector<Cell**>& slots) {
+    for (size_t i = pending; i < pendingend; ++i) {
+      slots.push_back(&trees[i]);
+    }
+  });
+  ParseWorkers workers(buf, ranges, trees, failed, jobs);
+  const size_t page = sysconf(_SC_PAGESIZE);
+  size_t scanned = 0, dropped = 0;
+  while (scanned < size) {
+    ranges.clear();
+    while (ranges.size() < PARSE_WINDOW && scanned < size) {
+      scanned = min(scanned + READ_BLOCK_SIZE, size);
+      scanblock(buf, scanned, st, collect);
+    }
+    if (scanned == size) {
+      scanfinish(buf, size, st, collect);
+    }
+
+    trees.assign(ranges.size(), NULL);
+    failed.assign(ranges.size(), false);
+    workers.parse();
+
+    pendingend = ranges.size();
+    for (size_t i = 0; i < ranges.size(); ++i) {
+      pending = i + 1;
+      if (failed[i]) {
+        parse_eval_print(buf + ranges[i].first, buf + ranges[i].second);
+      } else {
+        eval_print(trees[i]);
+      }
+    }
+    pending = pendingend = 0;
+
+    // the file is read-only, so its pages are read again if needed
+    size_t keep = st.start / page * page;
+    if (keep > dropped) {
+      madvise(const_cast<char*>(buf) + dropped, keep - dropped, MADV_DONTNEED);
+      dropped = keep;
+    }
+  }
+  unmapfile(buf, size);
+}
+
+/**
+ * \brief Check whether a file is in the precompiled binary format.
+ * Only regular files are examined, since peeking at a pipe would
+ * consume its input.
+ * \param fn The file name.
+ * \return True iff the file starts with the binary format magic.
+ */
+bool is_binary_file(char* fn)
+{
+  struct stat sb;
+  if (stat(fn, &sb) < 0 || !S_ISREG(sb.st_mode)) {
+    return false;
+  }
+  char magic[8];
+  ifstream fin(fn, ios::binary);
+  fin.read(magic, sizeof(magic));
+  return is_binary(magic, fin.gcount());
+}
+
+/**
+ * \brief Map a file, or read it whole into contents if it cannot be
+ * mapped.
+ * \param fn The file name.
+ * \param buf Set to the first character of the file.
+ * \param size Set to the size of the file.
+ * \param contents Holds the file if it was read instead of mapped.
+ * \return True iff the file was mapped and must be unmapped.
+ */
+bool loadfile(char* fn, const char*& buf, size_t& size, string& contents)
+{
+  if (mapfile(fn, buf, size)) {
+    return true;
+  }
+  ifstream fin(fn, ios::binary);
+  contents.assign(istreambuf_iterator<char>(fin), istreambuf_iterator<char>());
+  buf = contents.data();
+  size = contents.size();
+  return false;
+}
+
+/**
+ * \brief Evaluate and print the trees of a precompiled binary file in
+ * order.  The file is memory-mapped and the trees are rebuilt straight
+ * from it, with no text parsing.
+ * \param fn The file name.
+ */
+void readfile_binary(char* fn)
+{
+  const char* buf;
+  size_t size;
+  string contents;
+  bool mapped = loadfile(fn, buf, size, contents);
+  try {
+    BinaryReader br;
+    open_binary(br, buf, size);
+    HashConsScope shared(hashcons);
+    while (more_trees(br)) {
+      ArenaScope scope(exprarena);
+      eval_print(read_tree(br));
+    }
+  } catch (runtime_error& e) {
+    cerr << e.what();
+    exit(1);
+  }
+  if (mapped) {
+    unmapfile(buf, size);
+  }
+}
+
+/**
+ * \brief Parse every top-level expression of a source file and save
+ * the trees in the precompiled binary format.
+ * \param in The source file name.
+ * \param out The binary file name.
+ */
+void compilefile(char* in, char* out)
+{
+  const char* buf;
+  size_t size;
+  string contents;
+  bool mapped = loadfile(in, buf, size, contents);
+
+  BinaryWriter bw;
+  size_t count = 0;
+  ExprHandler compile = [&](const char* b, const char* e) {
+    ++count;
+    try {
+      write_tree(bw, parse_quiet(b, e));
+    } catch (runtime_error& err) {
+      cerr << err.what() << " (expression " << count << " of '" << in
+           << "')" << endl;
+      exit(1);
+    }
+  };
+  ScanState st;
+  scanblock(buf, size, st, compile);
+  scanfinish(buf, size, st, compile);
+  if (mapped) {
+    unmapfile(buf, size);
+  }
+
+  ofstream fout(out, ios::binary);
+  write_binary(bw, fout);
+  if (!fout) {
+    cerr << "ERROR: Cannot write file '" << out << "'.\n";
+    exit(1);
+  }
+}
+
 /**
  * \brief Read, parse, evaluate, and print the expression one by one from
  * the standard input, interactively.
@@ -168,22 +699,90 @@ void readconsole()
 
 /**
  * \brief Call either the batch or interactive main drivers.
+ *
+ * Usage: main [--mmap] [--jobs=N] [--cache=N] [--hash-cons]
+ * [--gc-pause-ms=N] [file], or main --compile in.scm out.scmb.  With
+ * --jobs=0 one parsing thread is used per core, and never more than
+ * JOBS_PER_CORE per core.  --cache=N keeps the trees of the N most
+ * recently parsed distinct expressions and reports its hit and miss
+ * counts at exit.  --hash-cons stores each distinct subtree of the
+ * parse trees once, and reports its counts at exit.
+ * --gc-pause-ms=N collects incrementally, marking for at most N
+ * milliseconds between expressions.  A file in the precompiled binary
+ * format is recognised by its magic bytes and loaded without parsing.
  */
 int main(int argc, char* argv[])
 {
-  switch(argc) {
-  case 1:
+  bool usemmap = false;
+  unsigned jobs = 1;
+  long cachesize = 0;
+  char* fn = NULL;
+  for (int i = 1; i < argc; ++i) {
+    if (0 == strcmp(argv[i], "--compile")) {
+      if (i + 2 >= argc) {
+        cout << "usage: --compile in.scm out.scmb" << endl;
+        exit(0);
+      }
+      compilefile(argv[i + 1], argv[i + 2]);
+      return 0;
+    } else if (0 == strcmp(argv[i], "--mmap")) {
+      usemmap = true;
+    } else if (0 == strcmp(argv[i], "--hash-cons")) {
+      hashcons = true;
+    } else if (0 == strncmp(argv[i], "--cache=", 8)) {
+      cachesize = atol(argv[i] + 8);
+    } else if (0 == strncmp(argv[i], "--gc-pause-ms=", 14)) {
+      gc_set_pause_budget(atof(argv[i] + 14));
+    } else if (0 == strncmp(argv[i], "--jobs=", 7)) {
+      char* end;
+      long n = strtol(argv[i] + 7, &end, 10);
+      if (end == argv[i] + 7 || '\0' != *end || n < 0) {
+        cout << "bad value for option " << argv[i] << endl;
+        exit(0);
+      }
+      unsigned cores = max(1u, thread::hardware_concurrency());
+      jobs = 0 == n ? cores : static_cast<unsigned>(min<long>(n, cores * JOBS_PER_CORE));
+    } else if (0 == strncmp(argv[i], "--", 2)) {
+      cout << "unknown option " << argv[i] << endl;
+      exit(0);
+    } else if (NULL == fn) {
+      fn = argv[i];
+    } else {
+      cout << "too many arguments!" << endl;
+      exit(0);
+    }
+  }
+
+  if (cachesize > 0) {
+    parsecache = new ParseCache(cachesize);
+  }
+
+  if (NULL == fn) {
     // read from the standard input
     readconsole();
-    exit(0);
-    break;
-  case 2:
+  } else if (is_binary_file(fn)) {
+    // rebuild precompiled trees without parsing
+    readfile_binary(fn);
+  } else if (jobs > 1) {
+    // parse a memory-mapped file on several threads
+    readfile_parallel(fn, jobs);
+  } else if (usemmap) {
+    // read from a memory-mapped file
+    readfile_mmap(fn);
+  } else {
     // read from a file
-    readfile(argv[1]);
-    break;
-  default:
-    cout << "too many arguments!" << endl;
-    exit(0);
+    readfile(fn);
+  }
+
+  if (NULL != parsecache) {
+    cerr << "parse cache: " << parsecache->hits() << " hits, "
+         << parsecache->misses() << " misses, "
+         << parsecache->size() << " entries" << endl;
+  }
+  if (hashcons) {
+    HashConsStats hs = hash_cons_stats();
+    cerr << "hash-cons: " << hs.hits << " hits, " << hs.misses << " misses, "
+         << hs.size << " cells" << endl;
   }
   return 0;
 }
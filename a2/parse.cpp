@@ -3,10 +3,36 @@
  *
  * Implementation of a parser that analyzes a string containing an
  * s-expression, and determines its tree structure.
+ *
+ * The reader walks the input exactly once with a cursor, building the
+ * cells bottom-up as each list closes, so the cost of parsing is
+ * linear in the length of the input.
  */
 
 #include "parse.hpp"
-bool inparsecar;
+#include "scan.hpp"
+#include <vector>
+#include <charconv>
+
+/**
+ * \brief True while the current thread parses in quiet mode.
+ */
+static thread_local bool quietparse = false;
+
+/**
+ * \brief Report a malformed s-expression.  In quiet mode the message is
+ * thrown as a runtime_error instead of being printed, so the caller can
+ * report it later in its proper place in the output.
+ * \param msg The error message.
+ */
+static void parse_error(const char* msg)
+{
+  if (quietparse) {
+    throw runtime_error(msg);
+  }
+  cout << msg << endl;
+}
+
 // check whether chr is white space
 bool iswhitespace(char ch)
 {
@@ -19,179 +45,138 @@ bool iswhitespace(char ch)
 
 
 /**
- * \brief Check whether numericstr is an legal numericstr string
- * \param str The string to be checked
- * \return ture if numericstr is an legal numericstr string, false otherwise
+ * \brief Classify a numeric literal in a single pass: an optional sign,
+ * then digits with at most one dot, and at least one digit.
+ * \param str The literal to be checked.
+ * \param isdouble Set to true iff the literal contains a dot.
+ * \return True iff str is a legal numeric literal.
  */
-bool is_legalnumeric(string str) 
+static bool classifynumeric(string_view str, bool& isdouble)
 {
-  int dotnum = 0;
-  int length = str.length();
-  int i;
-  if ('.' == str[0]) {
-    dotnum ++;
-  } else if ( !((str[0] >= '0') && (str[0] <= '9')) && ('+'!=str[0]) && ('-'!=str[0])) {
-    return false;
+  size_t length = str.length();
+  size_t i = 0;
+  bool hasdigit = false;
+  isdouble = false;
+  if (length > 0 && ('+' == str[0] || '-' == str[0])) {
+    i ++;
   }
-  for (i = 1; i < length; i ++) {
-    if ('.' == str[i]) {
-      dotnum ++;
-    } else if ((str[i] < '0') || (str[i] > '9')) {
+  for (; i < length; i ++) {
+    if ('.' == str[i] && !isdouble) {
+      isdouble = true;
+    } else if ((str[i] >= '0') && (str[i] <= '9')) {
+      hasdigit = true;
+    } else {
       return false;
     }
   }
-  if (dotnum>1) {
-    return false;
-  }
-  return true;
+  return hasdigit;
 }
 
 /**
- * \brief Check whether str is a legal operator
- * 
+ * \brief Check whether numericstr is an legal numericstr string
+ * \param str The string to be checked
+ * \return ture if numericstr is an legal numericstr string, false otherwise
  */
-bool is_legaloperator(string str)
+bool is_legalnumeric(string_view str)
 {
-  return true;
+  bool isdouble;
+  return classifynumeric(str, isdouble);
 }
 
-void readsinglesymbol(string& substring, string& sexpr)
+/**
+ * \brief Check whether str is a legal operator
+ * 
+ */
+bool is_legaloperator(string_view str)
 {
-  char currentchar;
-  int i = 0;
-  int length = substring.length();
-
-  // get the first character
-  currentchar = substring[i];
-
-  if (currentchar == '\"') {
-    // read a string literal
-    sexpr += currentchar;
-    do {
-      ++i;
-      currentchar = substring[i];
-      sexpr += currentchar;
-    } while (currentchar != '\"' && i < length-1);
-    if ('\"' != currentchar) {
-      cout << "error: illegal string" << endl;
-      exit(1);
-    }
-  } else {
-    // read a numeric literal or operator
-    do {
-      sexpr += currentchar;
-      ++i;
-      if (i >= static_cast<int>(substring.size())) {
-	break;
-      }
-      currentchar = substring[i];
-    } while ((!iswhitespace(currentchar)) && (currentchar != '(') && currentchar != '\"');
-    --i;
-  }
-  substring = substring.substr(i+1, length - i - 1);
+  return true;
 }
 
-
 /**
- * \brief Clear the whitespace at the begining and end of string sexpr.
- * \param sexpr The string.
+ * \brief Clear the whitespace at the begining and end of the text
+ * between begin and end, by moving the two bounds inwards.
+ * \param begin The first character of the text.
+ * \param end One past the last character of the text.
  */
-void clearwhitespace(string& sexpr)
+void clearwhitespace(const char*& begin, const char*& end)
 {
-  if (sexpr.size() <= 0) {
-    return;
-  }
-  int leftvalidpos;
-  int rightvalidpos;
-  int length = sexpr.size();
-  int i;
   // most left non-whitespace position
-  for (i = 0; i < length; ++i) {
-    if (iswhitespace(sexpr[i])) {
-      continue;
-    } else {
-      leftvalidpos = i;
-      break;
-    }
+  while (begin < end && iswhitespace(*begin)) {
+    ++begin;
   }
-
   // most right non-whitespace position
-  for (i = length - 1; i >= 0; i --) {
-    if (iswhitespace(sexpr[i])) {
-      continue;
-    } else {
-      rightvalidpos = i;
-      break;
-    }
+  while (begin < end && iswhitespace(*(end - 1))) {
+    --end;
   }
-
-  // delete the white space at the beginning and end
-  if ( i == -1 ) sexpr = "";
-  else sexpr  =  sexpr.substr(leftvalidpos, rightvalidpos - leftvalidpos + 1);
 }
 
 /**
- * \brief Check whether the s-expression legal
+ * \brief Check whether the s-expression between begin and end is legal.
+ * \param begin The first character of the s-expression.
+ * \param end One past the last character of the s-expression.
  */
-bool is_legalexpr(string sexpr)
+bool is_legalexpr(const char* begin, const char* end)
 {
-  clearwhitespace(sexpr);
-  if (sexpr.length()==0) {
-    cout << "blank string " << endl;
+  clearwhitespace(begin, end);
+  const char* sexpr = begin;
+  int length = end - begin;
+  if (length==0) {
+    parse_error("blank string ");
     return false;
   }
   if (')' == sexpr[0]) {
-    cout << "error: illegal s-expression" << endl;
+    parse_error("error: illegal s-expression");
     return false;
   }
   if ('(' == sexpr[0]) {
     // it is expression
-    int length = sexpr.length();
     int inumleftparenthesis = 1;
-    int i;
     int quotationmark = 0;
-    for (i = 1; i < length; i ++ ) {
-      if ('\"' == sexpr[i]) {
+    // jump from one structural character to the next; inside a string
+    // literal only the closing quote matters
+    const char* cur = sexpr + 1;
+    ScanIndex index(end);
+    while (cur < end) {
+      cur = index.find(cur, 0 == quotationmark
+                      ? SCAN_OPEN | SCAN_CLOSE | SCAN_QUOTE : SCAN_QUOTE);
+      if (cur == end) {
+        break;
+      }
+      if ('\"' == *cur) {
         quotationmark ++;
         quotationmark = quotationmark%2;
-      } else if ('(' == sexpr[i] && 0 == quotationmark) {
+      } else if ('(' == *cur) {
         inumleftparenthesis ++;
-      } else if (')' == sexpr[i] && 0 == quotationmark) {
+      } else {
         inumleftparenthesis --;
       }
       if (0 == inumleftparenthesis) {
         break;
       }
+      ++cur;
     }
+    int i = cur - sexpr;
     if ((i < length - 1) || (i == length) || (inumleftparenthesis > 0) || 0 != quotationmark) {
-      cout << "error: illegal s-expression " << endl;
+      parse_error("error: illegal s-expression ");
       return false;
     }
   } else if ('\"' != sexpr[0]) {
     // single element
-    if (string::npos != sexpr.find('(') || string::npos != sexpr.find(')') || string::npos != sexpr.find(' ') || string::npos != sexpr.find('\"'))  {
-      cout << "error: illegal s-expression " << endl;
+    if (end != scan_find(sexpr, end, SCAN_OPEN | SCAN_CLOSE | SCAN_QUOTE | SCAN_SPACE)) {
+      parse_error("error: illegal s-expression ");
       return false;
     }
     // check whether str is illegal numeric literal or illegal operator
-    if ((false == is_legalnumeric(sexpr)) && (false ==is_legaloperator(sexpr))) {
-      cout << "error: illegal numeric literal or illegal operator" << endl;
+    string_view str(sexpr, length);
+    if ((false == is_legalnumeric(str)) && (false ==is_legaloperator(str))) {
+      parse_error("error: illegal numeric literal or illegal operator");
       return false;
     }
   } else {
-    int length = sexpr.length();
-    int inumleft = 1;
-    int i;
-    for (i = 1; i < length; i ++) {
-      if ('\"' == sexpr[i]) {
-        inumleft ++;
-      }
-      if (2 == inumleft) {
-        break;
-      }
-    }
-    if ((i < length-1) || (inumleft != 2)) {
-      cout << "error: illegal s-expression " << endl;
+    // the closing quote must be the last character
+    const char* closing = scan_find(sexpr + 1, end, SCAN_QUOTE);
+    if (closing != end - 1) {
+      parse_error("error: illegal s-expression ");
       return false;
     }
   }
@@ -200,28 +185,45 @@ bool is_legalexpr(string sexpr)
 
 /**
  * \brief Make the cell.
- * \param str The string to represent the symbol, int or double.
+ *
+ * Numeric literals are classified in one pass and converted with
+ * std::from_chars straight from the slice, which neither copies the
+ * literal nor depends on the locale.  An int literal too large for
+ * int64_t becomes a bignum; a double literal that does not fit is
+ * reported rather than silently wrapped.
+ *
+ * \param tok The slice of the input holding the symbol, int or double.
  */
-Cell* makecell(string str)
+Cell* makecell(string_view tok)
 {
   Cell* root;
-  if (((str[0] >= '0') && (str[0] <= '9')) || (str[0] == '.') 
-      || ((('+'==str[0]) || ('-'==str[0]))&&(str.length()>1))) {
-    if (false == is_legalnumeric(str)) {
-      cout << "error: illegal numeric literal" << endl;
+  if (((tok[0] >= '0') && (tok[0] <= '9')) || (tok[0] == '.') 
+      || ((('+'==tok[0]) || ('-'==tok[0]))&&(tok.length()>1))) {
+    bool isdouble;
+    if (false == classifynumeric(tok, isdouble)) {
+      parse_error("error: illegal numeric literal");
       exit(1);
     }
-    // this is a numeric literal
-    if (string::npos == str.find('.')) {
-      // int number
-      char* fchar = const_cast<char*>(str.c_str());
-      int value = atoi(fchar);
-      root = make_int(value);
+    // this is a numeric literal; from_chars does not take a leading plus
+    const char* first = tok.data();
+    const char* last = first + tok.size();
+    if ('+' == *first) {
+      ++first;
+    }
+    int64_t ivalue = 0;
+    double dvalue = 0;
+    from_chars_result result = isdouble
+      ? from_chars(first, last, dvalue)
+      : from_chars(first, last, ivalue);
+    BigInt bvalue;
+    if (result.ec != errc::result_out_of_range) {
+      root = isdouble ? make_double(dvalue) : make_int(ivalue);
+    } else if (!isdouble && big_parse(string_view(first, last - first), bvalue)) {
+      // an int literal too large for int64_t is a bignum
+      root = make_integer(bvalue);
     } else {
-      // this is a double
-      char* fchar = const_cast<char*>(str.c_str());
-      double value = atof(fchar);   
-      root = make_double(value);
+      parse_error("error: numeric literal out of range");
+      exit(1);
     }
   } 
   
@@ -233,148 +235,128 @@ Cell* makecell(string str)
 //   } 
   else {
     // this is a symbol
-    if (false == is_legaloperator(str)) {
-      cout << "error: illegal operator" << endl;
+    if (false == is_legaloperator(tok)) {
+      parse_error("error: illegal operator");
       exit(1);
     }
-    root = make_symbol(const_cast<char*>(str.data()));
+    root = make_symbol(tok);
   }
   return root;
 }
 
-Cell* separate_parse(string& sexpr); 
-
-Cell* parse(string sexpr)
+/**
+ * \brief Advance the cursor past any whitespace.
+ * \param cur The cursor, updated in place.
+ * \param end One past the last character of the input.
+ * \param index The structural index of the input.
+ */
+static void skipwhitespace(const char*& cur, const char* const end, ScanIndex& index)
 {
-  // is_legal(sexpr);
-  // delete the whitesapce at the begining and end
-  // such that the first and last character are not white space
-  clearwhitespace(sexpr);
-//   if (sexpr.length() == 0) {
-//     return nil;
-//   }
-  if (sexpr.length() == 0) {
-    return nil;
-  }
-  if ( !is_legalexpr(sexpr)) {
-    return nil;
+  // most gaps are a single character, so test that before scanning
+  if (cur < end && iswhitespace(*cur)) {
+    cur = index.find(cur + 1, SCAN_NONSPACE);
   }
-  // check whether is single symbol
-  // i.e. leaf cell
-  // if (string::npos == sexpr.find('(')) {
-  if ('(' != sexpr[0]) {
-    // this is leaf cell
-    // bulid this leaf cell
-    Cell* root = makecell( sexpr );
-    return root;
-  }
-
-  // the first and last character are '(' and ')', respectively
-  // delete the two characters
-  int length = sexpr.size();
-  sexpr = sexpr.substr(1, length-2);
-  clearwhitespace(sexpr);
-  length = sexpr.size();
-//   if ( inparsecar ) {
-//     if (sexpr == "") {
-//       Cell* ec = new Cell("()");
-//       return ec;
-//     }
-//   }
-  // separate the s-expression into two left and right subsexps
-  Cell* root = separate_parse(sexpr);
-
-  return root;
 }
 
 /**
- * \brief Separately parse the sexpr and build the tree.
- * \param instr The string which consists of s-expressions.
- * \return A pointer to the conspair cell at the root of the parse tree.
+ * \brief Read a single symbol, numeric literal or string literal at
+ * the cursor and build its leaf cell.
+ * \param cur The cursor, left just past the token.
+ * \param end One past the last character of the input.
+ * \param index The structural index of the input.
+ * \return The leaf cell.
  */
-Cell* separate_parse(string& instr)
+static Cell* readatom(const char*& cur, const char* const end, ScanIndex& index)
 {
-  string sexp;
-  bool isstartsexp = false;
-  int inumleftparenthesis = 0;
-
-  // check whether to read the end
-  clearwhitespace(instr);
-  // int length = instr.size();
-    // check whether it is a "()" sexpr
+  const char* start = cur;
+  if ('\"' == *cur) {
+    // read a string literal, up to and including the closing quote
+    cur = index.find(cur + 1, SCAN_QUOTE);
+    if (cur == end) {
+      parse_error("error: illegal string");
+      exit(1);
+    }
+    ++cur;
+  } else {
+    // read a numeric literal or operator
+    cur = index.find(cur, SCAN_SPACE | SCAN_OPEN | SCAN_CLOSE | SCAN_QUOTE);
+  }
+  return makecell(string_view(start, cur - start));
+}
 
-  while (instr.size() > 0) {
-    // read char by char
-    char currentchar = instr[0];
-    // skip some white space before new s-expression occurs
-    if ((true == iswhitespace(currentchar))&&(false == isstartsexp)) {
+/**
+ * \brief Read one s-expression at the cursor and build its tree.
+ *
+ * The elements of every list still open are kept on one explicit
+ * stack, and each list is consed together from the back once its
+ * closing parenthesis is seen.  Every character of the input is
+ * visited exactly once, and the C++ stack stays the same size however
+ * long or deeply nested the input is.
+ *
+ * \param cur The cursor, left just past the s-expression.
+ * \param end One past the last character of the input.
+ * \return A pointer to the root of the parse tree.
+ */
+static Cell* readsexpr(const char*& cur, const char* const end)
+{
+  vector<Cell*> elements;
+  // where the elements of each open list start in elements
+  vector<size_t> openlists;
+  ScanIndex index(end);
+  while (true) {
+    skipwhitespace(cur, end, index);
+    Cell* done;
+    if ('(' == *cur) {
+      ++cur;
+      openlists.push_back(elements.size());
       continue;
-    }
-    // run accross a new s-expression
-    if ((false == isstartsexp)&&(false == iswhitespace(currentchar))) {
-      // check whether single symbol
-      if ('(' != currentchar) {
-	// read single a single symbol
-	readsinglesymbol(instr, sexp);
-	clearwhitespace(instr);  
-	inparsecar = true;
-	Cell* car = parse(sexp);
-	inparsecar = false;
-	Cell* cdr = parse("(" + instr + ")");
-	Cell* root = cons(car, cdr);
-	sexp.clear();
-	return root;
-      } else {
-	// start new expression
-	isstartsexp = true;
-	// read left parenthesiss
-	sexp += currentchar;
-	instr = instr.substr(1, instr.size() -1);
-	inumleftparenthesis = 1;
+    } else if (')' == *cur) {
+      ++cur;
+      size_t first = openlists.back();
+      openlists.pop_back();
+      done = nil;
+      for (size_t i = elements.size(); i > first; --i) {
+        done = cons(elements[i - 1], done);
       }
+      elements.resize(first);
     } else {
-      // in the process of reading the current s-expression
-      if (true == isstartsexp) {
-	if (true == iswhitespace(currentchar)) {
-	  // append a blankspace
-	  sexp += ' ';
-	  instr = instr.substr(1, instr.size() -1);
-	} else {
-	  // append current character
-	  sexp += currentchar;
-	  instr = instr.substr(1, instr.size() -1);
-	  // count left parenthesiss
-	  if ('(' == currentchar) {
-	    inumleftparenthesis ++;
-	  }
-	  if (')' == currentchar) {
-	    inumleftparenthesis --;
-
-	    // check whether current s-expression ends
-	    if (0 == inumleftparenthesis) {
-	      // current s-expression ends
-	      isstartsexp = false;
-	      clearwhitespace(instr);
-	      inparsecar = true;
-	      Cell* car = parse(sexp);        
-	      inparsecar = false;
-	      int length = instr.length();
-	      Cell* cdr;
-	      Cell* root;
-	      if (length <= 0) {
-		cdr = nil;
-	      } else {
-		cdr = parse("(" + instr + ")");       
-	      }
-	      root = cons(car, cdr);
-	      sexp.clear();
-	      return root;     
-	    }
-	  }
-	}
-      }
+      done = readatom(cur, end, index);
+    }
+    if (openlists.empty()) {
+      return done;
     }
+    elements.push_back(done);
+  }
+}
+
+Cell* parse(const char* begin, const char* end)
+{
+  // delete the whitesapce at the begining and end
+  // such that the first and last character are not white space
+  clearwhitespace(begin, end);
+  if (begin == end) {
+    return nil;
   }
+  if ( !is_legalexpr(begin, end)) {
+    return nil;
+  }
+  return readsexpr(begin, end);
+}
 
-  return nil;
+Cell* parse_quiet(const char* begin, const char* end)
+{
+  quietparse = true;
+  try {
+    Cell* root = parse(begin, end);
+    quietparse = false;
+    return root;
+  } catch (...) {
+    quietparse = false;
+    throw;
+  }
+}
+
+Cell* parse(string sexpr)
+{
+  return parse(sexpr.data(), sexpr.data() + sexpr.size());
 }
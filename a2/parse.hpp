@@ -14,15 +14,34 @@
 using namespace std;
 
 /**
- * \brief Recursively parse sexpr and build the parse tree.  \param
- * sexpr The s-expression stored in a string variable (note that this
- * version of parse has side effects: it may alter the contents of
- * sexpr).
+ * \brief Parse sexpr in a single pass and build the parse tree.
+ * \param sexpr The s-expression stored in a string variable.
  *
  * \return A pointer to the conspair cell at the root of the parse tree.
  */
 Cell* parse(string sexpr);
 
+/**
+ * \brief Parse the s-expression held in the characters between begin
+ * and end in place, without copying it into a string first.
+ * \param begin The first character of the s-expression.
+ * \param end One past the last character of the s-expression.
+ *
+ * \return A pointer to the conspair cell at the root of the parse tree.
+ */
+Cell* parse(const char* begin, const char* end);
+
+/**
+ * \brief Parse like parse(begin, end), but without printing anything or
+ * exiting: a malformed s-expression throws a runtime_error carrying the
+ * error message instead.  Safe to call from several threads at once.
+ * \param begin The first character of the s-expression.
+ * \param end One past the last character of the s-expression.
+ *
+ * \return A pointer to the conspair cell at the root of the parse tree.
+ */
+Cell* parse_quiet(const char* begin, const char* end);
+
 /**
  * \brief Check whether the character is whitespace.
  * \return True if it is character, false else.
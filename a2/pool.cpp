@@ -0,0 +1,517 @@
+/**
+ * \file pool.cpp
+ *
+ * Implementation of the cell pools.
+ */
+
+#include "pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+/**
+ * \brief Number of size classes, one per multiple of 8 bytes.
+ */
+const size_t NUM_CLASSES = MAX_POOLED / 8;
+
+/**
+ * \brief Fewest empty slabs the depot keeps for reuse.  It keeps as
+ * many as the threads took between the last two collections, which is
+ * about what they take before the next one; slabs left empty beyond
+ * that go back to the system.
+ */
+const size_t DEPOT_SLABS = 16;
+
+/**
+ * \brief A freed cell, linked through its first word.
+ */
+struct FreeCell {
+  FreeCell* next;
+};
+
+struct ThreadPool;
+
+/**
+ * \brief Counters of finished threads, and the live thread pools, so
+ * that pool_stats() can sum them.  Never destroyed, so threads may
+ * finish during exit.
+ */
+struct PoolRegistry {
+  mutex lock;
+  PoolStats finished = { 0, 0, 0, 0 };
+  vector<ThreadPool*> live;
+  vector<SlabHeader*> slabs; ///< every pool and large slab
+  atomic<size_t> allocated{0};
+  char* permanent = NULL;    ///< next free byte for permanent cells
+  char* permanentend = NULL;
+  size_t sweep_next = 0;     ///< next slab to sweep
+  size_t sweep_end = 0;      ///< end of the slabs to sweep
+  size_t sweep_kept = 0;     ///< end of the slabs swept and kept
+  size_t kept_last = 0;      ///< slabs kept in use by the last sweep
+  size_t taken = 0;          ///< slabs taken since the sweep before
+  size_t swept_live = 0;     ///< bytes left allocated in them
+  size_t released = 0;       ///< slabs given back to the system
+  vector<FreeCell*> depot[NUM_CLASSES]; ///< batches of free cells for any thread
+  vector<pair<char*, char*> > tails[NUM_CLASSES]; ///< uncarved ends of slabs
+  vector<SlabHeader*> empty; ///< empty slabs for any size class
+};
+
+PoolRegistry& registry()
+{
+  static PoolRegistry* r = new PoolRegistry;
+  return *r;
+}
+
+/**
+ * \brief The free lists and current slabs of one thread.
+ */
+struct ThreadPool {
+  FreeCell* free[NUM_CLASSES] = {};
+  char* cur[NUM_CLASSES] = {};
+  char* limit[NUM_CLASSES] = {};
+  PoolStats stats = { 0, 0, 0, 0 };
+  size_t unpublished = 0; ///< bytes not yet added to the registry
+
+  ThreadPool()
+  {
+    PoolRegistry& r = registry();
+    lock_guard<mutex> guard(r.lock);
+    r.live.push_back(this);
+  }
+
+  ~ThreadPool()
+  {
+    PoolRegistry& r = registry();
+    lock_guard<mutex> guard(r.lock);
+    // what this thread did not use goes to the depot for the others
+    for (size_t c = 0; c < NUM_CLASSES; ++c) {
+      if (NULL != free[c]) {
+        r.depot[c].push_back(free[c]);
+      }
+      if (static_cast<size_t>(limit[c] - cur[c]) >= (c + 1) * 8) {
+        r.tails[c].push_back(make_pair(cur[c], limit[c]));
+      }
+    }
+    r.finished.allocations += stats.allocations;
+    r.finished.frees += stats.frees;
+    r.finished.slabs += stats.slabs;
+    r.allocated += unpublished;
+    for (size_t i = 0; i < r.live.size(); ++i) {
+      if (r.live[i] == this) {
+        r.live.erase(r.live.begin() + i);
+        break;
+      }
+    }
+  }
+};
+
+ThreadPool& thread_pool()
+{
+  static thread_local ThreadPool pool;
+  return pool;
+}
+
+/**
+ * \brief Take a slab for cells and record it for sweeping.
+ */
+SlabHeader* new_cell_slab(ThreadPool& pool, SlabKind kind, size_t bytes)
+{
+  PoolRegistry& r = registry();
+  {
+    lock_guard<mutex> guard(r.lock);
+    if (SLAB_POOL == kind && SLAB_SIZE == bytes && !r.empty.empty()) {
+      // an empty slab has clear bits, and only its size class changes
+      SlabHeader* slab = r.empty.back();
+      r.empty.pop_back();
+      r.slabs.push_back(slab);
+      return slab;
+    }
+  }
+  SlabHeader* slab = new_slab(kind, bytes);
+  ++pool.stats.slabs;
+  lock_guard<mutex> guard(r.lock);
+  r.slabs.push_back(slab);
+  return slab;
+}
+
+/**
+ * \brief Give a thread more cells of size class c: a batch of free
+ * cells or a slab tail from the depot, else an empty or new slab to
+ * carve.
+ */
+void refill(ThreadPool& pool, size_t c)
+{
+  PoolRegistry& r = registry();
+  {
+    lock_guard<mutex> guard(r.lock);
+    if (!r.depot[c].empty()) {
+      pool.free[c] = r.depot[c].back();
+      r.depot[c].pop_back();
+      return;
+    }
+    if (!r.tails[c].empty()) {
+      pool.cur[c] = r.tails[c].back().first;
+      pool.limit[c] = r.tails[c].back().second;
+      r.tails[c].pop_back();
+      return;
+    }
+  }
+  SlabHeader* slab = new_cell_slab(pool, SLAB_POOL, SLAB_SIZE);
+  slab->size = (c + 1) * 8;
+  pool.cur[c] = slab_begin(slab);
+  pool.limit[c] = reinterpret_cast<char*>(slab) + SLAB_SIZE;
+}
+
+/**
+ * \brief Count bytes allocated, publishing them in steps of a slab.
+ */
+void count_bytes(ThreadPool& pool, size_t size)
+{
+  pool.unpublished += size;
+  if (pool.unpublished >= SLAB_SIZE) {
+    registry().allocated += pool.unpublished;
+    pool.unpublished = 0;
+  }
+}
+
+/**
+ * \brief Whether new cells are marked, while a collection is marking.
+ */
+bool allocate_marked = false;
+
+/**
+ * \brief Record that a cell starts at p.
+ */
+inline void set_live(void* p)
+{
+  size_t g = granule_of(p);
+  SlabHeader* slab = slab_of(p);
+  slab->live[g / 64] |= 1ull << (g % 64);
+  if (allocate_marked || slab->unswept) {
+    slab->marked[g / 64] |= 1ull << (g % 64);
+  }
+}
+
+}
+
+/**
+ * \brief Allocate a slab.
+ * \param kind What the slab is for.
+ * \param bytes The slab size, a multiple of SLAB_SIZE.
+ * \return The slab, starting with its header.
+ */
+SlabHeader* new_slab(SlabKind kind, size_t bytes)
+{
+  void* p = aligned_alloc(SLAB_SIZE, bytes);
+  if (NULL == p) {
+    throw bad_alloc();
+  }
+  SlabHeader* slab = static_cast<SlabHeader*>(p);
+  slab->kind = kind;
+  slab->size = 0;
+  slab->unswept = false;
+  memset(slab->live, 0, sizeof(slab->live));
+  memset(slab->marked, 0, sizeof(slab->marked));
+  return slab;
+}
+
+/**
+ * \brief Free a slab.
+ * \param slab The slab.
+ */
+void delete_slab(SlabHeader* slab)
+{
+  free(slab);
+}
+
+/**
+ * \brief Allocate a cell from the pool of its size class.
+ * \param size The cell size.
+ * \return The memory, 8-byte aligned.
+ */
+void* pool_allocate(size_t size)
+{
+  ThreadPool& pool = thread_pool();
+  ++pool.stats.allocations;
+  if (size > MAX_POOLED) {
+    size_t bytes = (sizeof(SlabHeader) + size + SLAB_SIZE - 1) & ~(SLAB_SIZE - 1);
+    SlabHeader* slab = new_cell_slab(pool, SLAB_LARGE, bytes);
+    slab->size = bytes;
+    count_bytes(pool, bytes);
+    void* p = slab_begin(slab);
+    set_live(p);
+    return p;
+  }
+  size_t c = (size + 7) / 8 - 1;
+  size = (c + 1) * 8;
+  count_bytes(pool, size);
+  if (NULL == pool.free[c] && static_cast<size_t>(pool.limit[c] - pool.cur[c]) < size) {
+    refill(pool, c);
+  }
+  void* p;
+  if (NULL != pool.free[c]) {
+    FreeCell* cell = pool.free[c];
+    pool.free[c] = cell->next;
+    p = cell;
+  } else {
+    p = pool.cur[c];
+    pool.cur[c] += size;
+  }
+  set_live(p);
+  return p;
+}
+
+/**
+ * \brief Allocate a cell that is never freed nor collected, such as an
+ * interned symbol.  Safe to call from several threads.
+ * \param size The cell size, at most MAX_POOLED.
+ * \return The memory, 8-byte aligned.
+ */
+void* permanent_allocate(size_t size)
+{
+  size = (size + 7) & ~static_cast<size_t>(7);
+  PoolRegistry& r = registry();
+  lock_guard<mutex> guard(r.lock);
+  if (static_cast<size_t>(r.permanentend - r.permanent) < size) {
+    SlabHeader* slab = new_slab(SLAB_PERMANENT);
+    r.permanent = slab_begin(slab);
+    r.permanentend = reinterpret_cast<char*>(slab) + SLAB_SIZE;
+  }
+  void* p = r.permanent;
+  r.permanent += size;
+  return p;
+}
+
+/**
+ * \brief Return a cell to the free list of its size class on this
+ * thread.
+ * \param p Memory from pool_allocate.
+ */
+void pool_free(void* p)
+{
+  ThreadPool& pool = thread_pool();
+  ++pool.stats.frees;
+  SlabHeader* slab = slab_of(p);
+  size_t g = granule_of(p);
+  slab->live[g / 64] &= ~(1ull << (g % 64));
+  if (SLAB_LARGE == slab->kind) {
+    // left empty in the registry until the next sweep drops it
+    slab->kind = SLAB_POOL;
+    slab->size = 0;
+    return;
+  }
+  if (slab->unswept) {
+    // the sweep lists every free cell of the slab when it gets there
+    return;
+  }
+  size_t c = slab->size / 8 - 1;
+  FreeCell* cell = static_cast<FreeCell*>(p);
+  cell->next = pool.free[c];
+  pool.free[c] = cell;
+}
+
+/**
+ * \brief Free every pool cell that is allocated but not marked, and
+ * clear the marks.  Freed cells go to the depot, where any thread can
+ * take them.  Must not run while other threads allocate.
+ * \param finalize Called on each freed cell before it is reused.
+ * \return The bytes held by cells that stay allocated.
+ */
+size_t pool_sweep(void (*finalize)(void*))
+{
+  pool_sweep_begin();
+  pool_sweep_step(finalize, SIZE_MAX);
+  return pool_swept_live();
+}
+
+/**
+ * \brief Start an incremental sweep of the slabs that exist now.
+ * Until pool_sweep_step() reaches a slab, the cells allocated in it are
+ * marked, so that they are kept.
+ */
+void pool_sweep_begin()
+{
+  PoolRegistry& r = registry();
+  lock_guard<mutex> guard(r.lock);
+  // the sweep lists the free cells of every slab it reaches afresh, so
+  // the lists and tails handed out so far are dropped; that way no list
+  // points into a slab the sweep finds empty and gives away
+  for (ThreadPool* pool : r.live) {
+    for (size_t c = 0; c < NUM_CLASSES; ++c) {
+      pool->free[c] = NULL;
+      pool->cur[c] = pool->limit[c] = NULL;
+    }
+  }
+  for (size_t c = 0; c < NUM_CLASSES; ++c) {
+    r.depot[c].clear();
+    r.tails[c].clear();
+  }
+  for (SlabHeader* slab : r.slabs) {
+    slab->unswept = true;
+  }
+  r.taken = r.slabs.size() - r.kept_last;
+  r.sweep_next = 0;
+  r.sweep_end = r.slabs.size();
+  r.sweep_kept = 0;
+  r.swept_live = 0;
+}
+
+/**
+ * \brief Sweep some of the slabs left by pool_sweep_begin(), as
+ * pool_sweep() would.  Must not run while other threads allocate.
+ * \param finalize Called on each freed cell before it is reused.
+ * \param max_slabs The most slabs to sweep.
+ * \return True iff the sweep is over.
+ */
+bool pool_sweep_step(void (*finalize)(void*), size_t max_slabs)
+{
+  ThreadPool& pool = thread_pool();
+  PoolRegistry& r = registry();
+  lock_guard<mutex> guard(r.lock);
+  // the freed cells of each size class, in address order, become one
+  // batch in the depot
+  FreeCell* freed[NUM_CLASSES] = {};
+  FreeCell** link[NUM_CLASSES];
+  for (size_t c = 0; c < NUM_CLASSES; ++c) {
+    link[c] = &freed[c];
+  }
+  size_t& live = r.swept_live;
+  size_t& kept = r.sweep_kept;
+  size_t last = r.sweep_end - r.sweep_next > max_slabs ? r.sweep_next + max_slabs : r.sweep_end;
+  for (; r.sweep_next < last; ++r.sweep_next) {
+    SlabHeader* slab = r.slabs[r.sweep_next];
+    slab->unswept = false;
+    if (0 == slab->size) {
+      // a large slab freed with pool_free
+      delete_slab(slab);
+      ++r.released;
+      continue;
+    }
+    if (SLAB_LARGE == slab->kind) {
+      size_t g = granule_of(slab_begin(slab));
+      if (slab->marked[g / 64] & (1ull << (g % 64))) {
+        slab->marked[g / 64] = 0;
+        live += slab->size;
+        r.slabs[kept++] = slab;
+      } else {
+        finalize(slab_begin(slab));
+        ++pool.stats.frees;
+        delete_slab(slab);
+        ++r.released;
+      }
+      continue;
+    }
+    size_t c = slab->size / 8 - 1;
+    bool empty = true;
+    for (size_t w = 0; w < SLAB_GRANULES / 64; ++w) {
+      uint64_t dead = slab->live[w] & ~slab->marked[w];
+      live += __builtin_popcountll(slab->live[w] & slab->marked[w]) * slab->size;
+      slab->live[w] &= slab->marked[w];
+      slab->marked[w] = 0;
+      empty = empty && 0 == slab->live[w];
+      while (0 != dead) {
+        size_t g = w * 64 + __builtin_ctzll(dead);
+        dead &= dead - 1;
+        finalize(reinterpret_cast<char*>(slab) + g * 8);
+        ++pool.stats.frees;
+      }
+    }
+    if (empty) {
+      if (r.empty.size() < max(DEPOT_SLABS, r.taken)) {
+        r.empty.push_back(slab);
+      } else {
+        delete_slab(slab);
+        ++r.released;
+      }
+      continue;
+    }
+    // every cell not allocated is free, whether it died now, was freed
+    // before, or was never carved
+    char* end = reinterpret_cast<char*>(slab) + SLAB_SIZE;
+    for (char* p = slab_begin(slab); p + slab->size <= end; p += slab->size) {
+      size_t g = granule_of(p);
+      if (0 == (slab->live[g / 64] & (1ull << (g % 64)))) {
+        FreeCell* cell = reinterpret_cast<FreeCell*>(p);
+        *link[c] = cell;
+        link[c] = &cell->next;
+      }
+    }
+    r.slabs[kept++] = slab;
+  }
+  for (size_t c = 0; c < NUM_CLASSES; ++c) {
+    if (NULL != freed[c]) {
+      *link[c] = NULL;
+      r.depot[c].push_back(freed[c]);
+    }
+  }
+  if (r.sweep_next < r.sweep_end) {
+    return false;
+  }
+  // slabs taken during the sweep follow the swept ones
+  r.slabs.erase(r.slabs.begin() + kept, r.slabs.begin() + r.sweep_end);
+  r.sweep_end = r.sweep_next = kept;
+  r.kept_last = kept;
+  return true;
+}
+
+/**
+ * \brief Accessor.
+ * \return The bytes held by cells that stayed allocated in the slabs
+ * swept since pool_sweep_begin().
+ */
+size_t pool_swept_live()
+{
+  return registry().swept_live;
+}
+
+/**
+ * \brief Mark the cells allocated from now on, so that a collection
+ * under way keeps them.  Must not change while other threads allocate.
+ * \param marked True while a collection is marking.
+ */
+void pool_set_allocate_marked(bool marked)
+{
+  allocate_marked = marked;
+}
+
+/**
+ * \brief Bytes allocated from the pools so far, by all threads.  Each
+ * thread publishes its count in steps of SLAB_SIZE.
+ */
+size_t pool_allocated_bytes()
+{
+  return registry().allocated;
+}
+
+void pool_count_external(size_t bytes)
+{
+  count_bytes(thread_pool(), bytes);
+}
+
+/**
+ * \brief Read the allocation counters.  Threads still running are
+ * not stopped, so their counters are a snapshot.
+ * \return The counters of every thread, live or finished.
+ */
+PoolStats pool_stats()
+{
+  PoolRegistry& r = registry();
+  lock_guard<mutex> guard(r.lock);
+  PoolStats total = r.finished;
+  total.released = r.released;
+  for (ThreadPool* pool : r.live) {
+    total.allocations += pool->stats.allocations;
+    total.frees += pool->stats.frees;
+    total.slabs += pool->stats.slabs;
+  }
+  return total;
+}
@@ -0,0 +1,246 @@
+/**
+ * \file pool.hpp
+ *
+ * Encapsulates the interface for the cell pools.  Heap cells are carved
+ * out of slabs, each holding cells of one size class, with a free list
+ * per size class and thread.  A shared depot holds the free cells no
+ * thread owns: those found by the sweep and those left by threads that
+ * finished, along with empty slabs for reuse.  Slabs are aligned to their size, so the
+ * slab of any cell, and with it the allocator that owns the cell, is
+ * found by masking the cell address.
+ *
+ * Each slab header holds a live bit and a mark bit per 8-byte granule,
+ * set for the first granule of every allocated and every marked cell,
+ * which is all the garbage collector needs to sweep the pools.
+ */
+
+#ifndef POOL_HPP
+#define POOL_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * \brief Size and alignment of a slab.
+ */
+const size_t SLAB_SIZE = 64 * 1024;
+
+/**
+ * \brief Size of a cache line; slab headers take one, so the cells
+ * after them start on a line boundary.
+ */
+const size_t CACHE_LINE = 64;
+
+/**
+ * \brief Largest cell size served from the size-class pools.  Larger
+ * cells get a slab of their own.
+ */
+const size_t MAX_POOLED = 64;
+
+/**
+ * \brief Number of 8-byte granules in a slab.
+ */
+const size_t SLAB_GRANULES = SLAB_SIZE / 8;
+
+/**
+ * \brief What the memory of a slab is used for.
+ */
+enum SlabKind : uint32_t {
+  SLAB_POOL,  ///< cells of one size class
+  SLAB_ARENA, ///< a chunk of an expression arena
+  SLAB_LARGE, ///< a single cell larger than MAX_POOLED
+  SLAB_PERMANENT ///< cells that are never freed
+};
+
+/**
+ * \brief The header at the start of every slab.
+ */
+struct alignas(CACHE_LINE) SlabHeader {
+  SlabKind kind;
+  uint32_t size; ///< cell size for SLAB_POOL, slab bytes for SLAB_LARGE,
+                 ///< chunk index for SLAB_ARENA
+  bool unswept;  ///< not yet reached by the sweep under way
+  uint64_t live[SLAB_GRANULES / 64];   ///< cells allocated
+  uint64_t marked[SLAB_GRANULES / 64]; ///< cells reached by the collector
+};
+
+/**
+ * \brief Allocate a slab.
+ * \param kind What the slab is for.
+ * \param bytes The slab size, a multiple of SLAB_SIZE.
+ * \return The slab, starting with its header.
+ */
+SlabHeader* new_slab(SlabKind kind, size_t bytes = SLAB_SIZE);
+
+/**
+ * \brief Free a slab.
+ * \param slab The slab.
+ */
+void delete_slab(SlabHeader* slab);
+
+/**
+ * \brief Find the slab holding p.
+ * \param p Memory from pool_allocate or an arena.
+ * \return The slab header.
+ */
+inline SlabHeader* slab_of(const void* p)
+{
+  return reinterpret_cast<SlabHeader*>(reinterpret_cast<uintptr_t>(p) & ~(SLAB_SIZE - 1));
+}
+
+/**
+ * \brief The first usable byte of a slab, after its header.
+ * \param slab The slab.
+ */
+inline char* slab_begin(SlabHeader* slab)
+{
+  return reinterpret_cast<char*>(slab) + sizeof(SlabHeader);
+}
+
+/**
+ * \brief The granule of a slab that p starts in.
+ * \param p Memory in the first SLAB_SIZE bytes of a slab.
+ */
+inline size_t granule_of(const void* p)
+{
+  return (reinterpret_cast<uintptr_t>(p) & (SLAB_SIZE - 1)) / 8;
+}
+
+/**
+ * \brief Check the mark bit of a pool cell.
+ * \param p A cell.
+ * \return True iff p is a pool cell that is marked.
+ */
+inline bool pool_marked(const void* p)
+{
+  SlabHeader* slab = slab_of(p);
+  size_t g = granule_of(p);
+  return (SLAB_POOL == slab->kind || SLAB_LARGE == slab->kind)
+    && (slab->marked[g / 64] & (1ull << (g % 64)));
+}
+
+/**
+ * \brief Check if a pool cell is about to be freed by the sweep under
+ * way: its slab has not been swept yet and it was not marked.
+ * \param p A pool cell.
+ * \return True iff p is garbage waiting to be swept.
+ */
+inline bool pool_condemned(const void* p)
+{
+  return slab_of(p)->unswept && !pool_marked(p);
+}
+
+/**
+ * \brief Set the mark bit of a pool cell.
+ * \param p A cell.
+ * \return True iff p is a pool cell that was not marked yet; arena
+ * and permanent cells are never marked.
+ */
+inline bool pool_mark(const void* p)
+{
+  SlabHeader* slab = slab_of(p);
+  if (SLAB_POOL != slab->kind && SLAB_LARGE != slab->kind) {
+    return false;
+  }
+  size_t g = granule_of(p);
+  uint64_t bit = 1ull << (g % 64);
+  if (slab->marked[g / 64] & bit) {
+    return false;
+  }
+  slab->marked[g / 64] |= bit;
+  return true;
+}
+
+/**
+ * \brief Allocate a cell from the pool of its size class.
+ * \param size The cell size.
+ * \return The memory, 8-byte aligned.
+ */
+void* pool_allocate(size_t size);
+
+/**
+ * \brief Allocate a cell that is never freed nor collected, such as an
+ * interned symbol.  Safe to call from several threads.
+ * \param size The cell size, at most MAX_POOLED.
+ * \return The memory, 8-byte aligned.
+ */
+void* permanent_allocate(size_t size);
+
+/**
+ * \brief Return a cell to the free list of its size class on this
+ * thread.
+ * \param p Memory from pool_allocate.
+ */
+void pool_free(void* p);
+
+/**
+ * \brief Free every pool cell that is allocated but not marked, and
+ * clear the marks.  Freed cells go to the depot, where any thread can
+ * take them.  Must not run while other threads allocate.
+ * \param finalize Called on each freed cell before it is reused.
+ * \return The bytes held by cells that stay allocated.
+ */
+size_t pool_sweep(void (*finalize)(void*));
+
+/**
+ * \brief Start an incremental sweep of the slabs that exist now.
+ * Until pool_sweep_step() reaches a slab, the cells allocated in it are
+ * marked, so that they are kept.
+ */
+void pool_sweep_begin();
+
+/**
+ * \brief Sweep some of the slabs left by pool_sweep_begin(), as
+ * pool_sweep() would.  Must not run while other threads allocate.
+ * \param finalize Called on each freed cell before it is reused.
+ * \param max_slabs The most slabs to sweep.
+ * \return True iff the sweep is over.
+ */
+bool pool_sweep_step(void (*finalize)(void*), size_t max_slabs);
+
+/**
+ * \brief Accessor.
+ * \return The bytes held by cells that stayed allocated in the slabs
+ * swept since pool_sweep_begin().
+ */
+size_t pool_swept_live();
+
+/**
+ * \brief Mark the cells allocated from now on, so that a collection
+ * under way keeps them.  Must not change while other threads allocate.
+ * \param marked True while a collection is marking.
+ */
+void pool_set_allocate_marked(bool marked);
+
+/**
+ * \brief Bytes allocated from the pools so far, by all threads.  Each
+ * thread publishes its count in steps of SLAB_SIZE.
+ */
+size_t pool_allocated_bytes();
+
+/**
+ * \brief Count memory that a heap cell holds outside the pools, such as
+ * the elements of a vector, among the bytes allocated, so that large
+ * payloads bring the next collection closer as cells do.
+ * \param bytes The size of the payload.
+ */
+void pool_count_external(size_t bytes);
+
+/**
+ * \brief Allocation counters, summed over all threads.
+ */
+struct PoolStats {
+  size_t allocations; ///< cells handed out
+  size_t frees;       ///< cells returned
+  size_t slabs;       ///< pool and large slabs taken from the system
+  size_t released;    ///< slabs given back to the system
+};
+
+/**
+ * \brief Read the allocation counters.  Threads still running are
+ * not stopped, so their counters are a snapshot.
+ * \return The counters of every thread, live or finished.
+ */
+PoolStats pool_stats();
+
+#endif // POOL_HPP
@@ -0,0 +1,130 @@
+/**
+ * \file scan.cpp
+ *
+ * Implementation of the structural scanner.  A block of the input is
+ * compared against every structural character at once and the results
+ * are folded into one bitmap per class, in the style of simdjson's
+ * first stage.  On x86 the AVX2 version is compiled alongside the SSE2
+ * one and picked at startup when the processor supports it, so the
+ * build needs no -mavx2; other targets get a portable version.
+ */
+
+#include "scan.hpp"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+/**
+ * \brief Classify a block one character at a time.
+ */
+void classify_scalar(const char* p, ScanBitmaps& b)
+{
+  b.open = b.close = b.quote = b.space = 0;
+  for (int i = 0; i < SCAN_BLOCK; ++i) {
+    uint64_t bit = uint64_t(1) << i;
+    char ch = p[i];
+    if ('(' == ch) {
+      b.open |= bit;
+    } else if (')' == ch) {
+      b.close |= bit;
+    } else if ('\"' == ch) {
+      b.quote |= bit;
+    } else if (' ' == ch || '\n' == ch || '\t' == ch || '\r' == ch) {
+      b.space |= bit;
+    }
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/**
+ * \brief Classify a block 16 characters at a time.
+ */
+__attribute__((target("sse2")))
+void classify_sse2(const char* p, ScanBitmaps& b)
+{
+  b.open = b.close = b.quote = b.space = 0;
+  for (int i = 0; i < SCAN_BLOCK; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+    __m128i s = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                   _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))),
+      _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')),
+                   _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+    b.open |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('('))))) << i;
+    b.close |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(')'))))) << i;
+    b.quote |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\"'))))) << i;
+    b.space |= uint64_t(uint16_t(_mm_movemask_epi8(s))) << i;
+  }
+}
+
+/**
+ * \brief Classify a block 32 characters at a time.
+ */
+__attribute__((target("avx2")))
+void classify_avx2(const char* p, ScanBitmaps& b)
+{
+  b.open = b.close = b.quote = b.space = 0;
+  for (int i = 0; i < SCAN_BLOCK; i += 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+    __m256i s = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                      _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))),
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')),
+                      _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))));
+    b.open |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('('))))) << i;
+    b.close |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(')'))))) << i;
+    b.quote |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\"'))))) << i;
+    b.space |= uint64_t(uint32_t(_mm256_movemask_epi8(s))) << i;
+  }
+}
+
+#endif
+
+/**
+ * \brief Pick the fastest classifier the processor supports.
+ */
+void (*pick_classify())(const char*, ScanBitmaps&)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return classify_avx2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return classify_sse2;
+  }
+#endif
+  return classify_scalar;
+}
+
+/**
+ * \brief The classifier, chosen once at startup.
+ */
+void (*const classify)(const char*, ScanBitmaps&) = pick_classify();
+
+}
+
+void scan_classify(const char* p, ScanBitmaps& b)
+{
+  classify(p, b);
+}
+
+void ScanIndex::load(const char* cur)
+{
+  // a tail shorter than a block is classified from a padded copy
+  base = cur;
+  if (end - cur >= SCAN_BLOCK) {
+    count = SCAN_BLOCK;
+    scan_classify(cur, bits);
+  } else {
+    char block[SCAN_BLOCK] = {0};
+    count = end - cur;
+    memcpy(block, cur, count);
+    scan_classify(block, bits);
+  }
+}
@@ -0,0 +1,148 @@
+/**
+ * \file scan.hpp
+ *
+ * Encapsulates the interface for the structural scanner, which finds
+ * the parentheses, quotes and whitespace that delimit s-expressions
+ * many bytes at a time, so the reader can jump from one structural
+ * character to the next instead of testing every byte.
+ */
+
+#ifndef SCAN_HPP
+#define SCAN_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * \brief Classes of structural characters, combined as a bit set.
+ */
+enum ScanKind {
+  SCAN_OPEN = 1,      ///< '('
+  SCAN_CLOSE = 2,     ///< ')'
+  SCAN_QUOTE = 4,     ///< '"'
+  SCAN_SPACE = 8,     ///< ' ', '\n', '\t' or '\r'
+  SCAN_NONSPACE = 16  ///< anything that is not whitespace
+};
+
+/**
+ * \brief Number of characters classified at once, one bit each in a
+ * 64-bit bitmap.
+ */
+const int SCAN_BLOCK = 64;
+
+/**
+ * \brief The structural bitmaps of one block of the input: bit i of a
+ * bitmap is set iff character i is in its class.
+ */
+struct ScanBitmaps {
+  uint64_t open;
+  uint64_t close;
+  uint64_t quote;
+  uint64_t space;
+};
+
+/**
+ * \brief Classify one block of the input.  AVX2 is used when the
+ * processor has it, which is checked once at startup, else SSE2 or
+ * portable code.
+ * \param p The first character of the block; SCAN_BLOCK characters
+ * must be readable from it.
+ * \param b Receives the bitmaps of the block.
+ */
+void scan_classify(const char* p, ScanBitmaps& b);
+
+/**
+ * \brief Combine the bitmaps of the classes in kinds.
+ * \param b The bitmaps of a block.
+ * \param kinds The classes of characters to look for.
+ * \return The bitmap of characters in any of the classes.
+ */
+inline uint64_t scan_select(const ScanBitmaps& b, unsigned kinds)
+{
+  uint64_t m = 0;
+  if (kinds & SCAN_OPEN) {
+    m |= b.open;
+  }
+  if (kinds & SCAN_CLOSE) {
+    m |= b.close;
+  }
+  if (kinds & SCAN_QUOTE) {
+    m |= b.quote;
+  }
+  if (kinds & SCAN_SPACE) {
+    m |= b.space;
+  }
+  if (kinds & SCAN_NONSPACE) {
+    m |= ~b.space;
+  }
+  return m;
+}
+
+/**
+ * \brief A scanner over one buffer that keeps the bitmaps of the block
+ * it classified last, so a run of searches landing in the same block
+ * classifies it once, whatever classes each search looks for.  The
+ * buffer must not change while the index is in use.
+ */
+class ScanIndex
+{
+public:
+  /**
+   * \brief Build an index over the characters before end.
+   * \param end One past the last character to examine.
+   */
+  explicit ScanIndex(const char* end) : end(end) {}
+
+  /**
+   * \brief Find the first character from cur on that belongs to one of
+   * the classes in kinds.
+   * \param cur The first character to examine.
+   * \param kinds The classes of characters to look for.
+   * \return The position of the first match, or end if there is none.
+   */
+  const char* find(const char* cur, unsigned kinds)
+  {
+    while (cur < end) {
+      if (cur < base || cur >= base + count) {
+        load(cur);
+      }
+      int offset = cur - base;
+      uint64_t m = scan_select(bits, kinds) >> offset;
+      if (count - offset < SCAN_BLOCK) {
+        m &= (uint64_t(1) << (count - offset)) - 1;
+      }
+      if (0 != m) {
+        return cur + __builtin_ctzll(m);
+      }
+      cur = base + count;
+    }
+    return end;
+  }
+
+private:
+  /**
+   * \brief Classify the block starting at cur.
+   */
+  void load(const char* cur);
+
+  const char* end;
+  const char* base = NULL;    ///< first character of the block classified
+  int count = 0;              ///< characters of the block before end
+  ScanBitmaps bits;
+};
+
+/**
+ * \brief Find the first character between cur and end that belongs to
+ * one of the classes in kinds.  Loops searching the same buffer should
+ * keep a ScanIndex instead.
+ * \param cur The first character to examine.
+ * \param end One past the last character to examine.
+ * \param kinds The classes of characters to look for.
+ * \return The position of the first match, or end if there is none.
+ */
+inline const char* scan_find(const char* cur, const char* end, unsigned kinds)
+{
+  return ScanIndex(end).find(cur, kinds);
+}
+
+#endif // SCAN_HPP
@@ -0,0 +1,53 @@
+/**
+ * \file testprimitive.cpp
+ *
+ * Checks that primitives registered before the first evaluation are
+ * found, that one may replace a builtin, and that the other builtins
+ * are still registered.
+ */
+
+#include "parse.hpp"
+#include "eval.hpp"
+#include <sstream>
+
+using namespace std;
+
+/**
+ * \brief A primitive doubling its int argument.
+ */
+Cell* eval_twice(Cell* const c)
+{
+  return make_int(2 * get_int(eval(car(c))));
+}
+
+/**
+ * \brief A replacement for floor that always gives 42.
+ */
+Cell* eval_answer(Cell* const c)
+{
+  return make_int(42);
+}
+
+int main()
+{
+  define_primitive("twice", { eval_twice, 1, 1,
+                              "ERROR: One parameter is needed for twice.\n" });
+  define_primitive("floor", { eval_answer, 1, 1,
+                              "ERROR: One parameter is needed for floor.\n" });
+  const char* cases[][2] = {
+    { "(twice (+ 1 2))", "6" },
+    { "(floor 2.5)", "42" },
+    { "(car (quote (7 8)))", "7" },
+    { "(vector-ref (list->vector (quote (1 2 3))) 2)", "3" },
+  };
+  int failed = 0;
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+    ostringstream os;
+    print_cell(os, eval(parse(string(cases[i][0]))));
+    if (os.str() != cases[i][1]) {
+      cout << cases[i][0] << " gave " << os.str() << ", not " << cases[i][1] << endl;
+      ++failed;
+    }
+  }
+  return 0 == failed ? 0 : 1;
+}